@@ -0,0 +1,135 @@
+#include "animation_export.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iostream>
+
+void AnimationExporter::start(Viewport& viewport, std::string path) {
+  if (isRunning())
+    return;
+  if (path.ends_with(".png"))
+    path.resize(path.size() - 4);
+  basePath = path;
+
+  fps = std::max(fps, 1.0f);
+  samples = std::max(samples, 1);
+  frameCount = std::max(static_cast<int>(std::lround((endTime - startTime) * fps)), 1);
+  nextFrame = 0;
+  frameStarted = false;
+  framesWritten = 0;
+  failed = 0;
+  peakBacklog = 0;
+
+  capture = std::make_unique<ImageCapture>(threads);
+  capture->ringSize = std::max(ringSize, 1);
+
+  // the viewport converges at samples, so the UI's own render() calls add nothing in between
+  saved = {viewport.progressive, viewport.alwaysRender, viewport.progressiveMaxSamples, viewport.fixedTime};
+  viewport.progressive = true;
+  viewport.alwaysRender = false;
+  viewport.progressiveMaxSamples = samples;
+
+  std::cout << "[Animation] Rendering " << frameCount << " frames at " << viewport.width << "x" << viewport.height << ", " << samples << " samples each, to " << basePath << "_*.png\n";
+  startClock = std::chrono::steady_clock::now();
+  endClock = startClock;
+}
+
+void AnimationExporter::update(Viewport& viewport, double budgetMs) {
+  if (!isRunning())
+    return;
+
+  auto begin = std::chrono::steady_clock::now();
+  while (nextFrame < frameCount) {
+    if (!frameStarted) {
+      viewport.fixedTime = startTime + static_cast<float>(nextFrame) / fps;
+      viewport.restartAccumulation();
+      frameStarted = true;
+    }
+    // a change seen by render() restarts the mean too, so count the samples instead of the calls
+    for (int i = 0; i < 4 * samples && viewport.getAccumulatedSamples() < samples; i++)
+      viewport.render();
+
+    // a shader swap or graph edit kept restarting it, the frame is finished by a later call
+    if (viewport.getAccumulatedSamples() < samples) {
+      std::cout << "[Animation] Frame " << nextFrame << " restarted by a change, continuing next update\n";
+      break;
+    }
+
+    frameStarted = false;
+    capture->request(viewport.taaFramebuffer.ID, viewport.width, viewport.height, framePath(nextFrame));
+    nextFrame++;
+    collect();
+
+    if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() >= budgetMs)
+      break;
+  }
+  collect();
+
+  if (nextFrame == frameCount && !capture->isBusy())
+    finish(viewport);
+}
+
+void AnimationExporter::cancel() {
+  if (!isRunning() || nextFrame == frameCount)
+    return;
+  frameCount = nextFrame;
+  std::cout << "[Animation] Cancelled after " << nextFrame << " frames\n";
+}
+
+void AnimationExporter::flush(Viewport& viewport) {
+  if (!isRunning())
+    return;
+  cancel();
+  capture->flush();
+  collect();
+  finish(viewport);
+}
+
+bool AnimationExporter::isRunning() const { return capture != nullptr; }
+
+int AnimationExporter::getFrameCount() const { return frameCount; }
+
+int AnimationExporter::getFramesRendered() const { return nextFrame; }
+
+int AnimationExporter::getFramesWritten() const { return framesWritten; }
+
+int AnimationExporter::getFailed() const { return failed; }
+
+double AnimationExporter::getSeconds() const {
+  auto end = isRunning() ? std::chrono::steady_clock::now() : endClock;
+  return std::chrono::duration<double>(end - startClock).count();
+}
+
+double AnimationExporter::getFramesPerSecond() const {
+  double seconds = getSeconds();
+  return seconds > 0.0 ? static_cast<double>(framesWritten) / seconds : 0.0;
+}
+
+int AnimationExporter::getBacklog() const { return isRunning() ? capture->getBacklog() : 0; }
+
+int AnimationExporter::getPeakBacklog() const { return peakBacklog; }
+
+std::string AnimationExporter::framePath(int frame) const { return std::format("{}_{:05}.png", basePath, frame); }
+
+void AnimationExporter::collect() {
+  capture->update();
+  peakBacklog = std::max(peakBacklog, capture->getBacklog());
+  for (const auto& result : capture->takeResults()) {
+    framesWritten++;
+    if (!result.saved)
+      failed++;
+  }
+}
+
+void AnimationExporter::finish(Viewport& viewport) {
+  capture.reset();
+  endClock = std::chrono::steady_clock::now();
+
+  viewport.progressive = saved.progressive;
+  viewport.alwaysRender = saved.alwaysRender;
+  viewport.progressiveMaxSamples = saved.progressiveMaxSamples;
+  viewport.fixedTime = saved.fixedTime;
+
+  std::cout << "[Animation] Wrote " << framesWritten - failed << " of " << frameCount << " frames in " << getSeconds() << " s, " << getFramesPerSecond() << " frames/s, peak encode backlog " << peakBacklog << "\n";
+}
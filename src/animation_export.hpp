@@ -0,0 +1,70 @@
+#ifndef ANIMATION_EXPORT_H
+#define ANIMATION_EXPORT_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "image_capture.hpp"
+#include "viewport.hpp"
+
+// Renders an image sequence at fixed uTime values. Every output frame restarts the progressive
+// accumulation of the viewport at startTime + frame / fps and takes samples full resolution
+// samples, so frames don't depend on the ones before. Readbacks go through the PBO ring of an
+// ImageCapture with one encoder per core, the GPU only waits once encoding falls behind the ring.
+class AnimationExporter {
+public:
+  float startTime = 0.0f;
+  float endTime = 5.0f; // exclusive
+  float fps = 30.0f;
+  int samples = 16; // per output frame
+  int ringSize = 6; // readbacks in flight before rendering waits for the encoders
+  int threads = 0;  // encoder threads, 0: one per hardware thread but the GL one
+
+  // frames are written to path_00000.png and on, a .png extension is dropped first
+  void start(Viewport& viewport, std::string path);
+
+  // renders output frames for about budgetMs, at least one, and finishes once all are written
+  void update(Viewport& viewport, double budgetMs);
+
+  // stops rendering, frames already rendered are still written
+  void cancel();
+
+  // cancels and waits until the rendered frames are written, before the GL context goes away
+  void flush(Viewport& viewport);
+
+  bool isRunning() const;
+
+  int getFrameCount() const;
+  int getFramesRendered() const;
+  int getFramesWritten() const;
+  int getFailed() const;
+  double getSeconds() const;         // since start, until the last frame was written
+  double getFramesPerSecond() const; // written frames per second
+  int getBacklog() const;            // frames read back and waiting for an encoder
+  int getPeakBacklog() const;
+
+private:
+  std::unique_ptr<ImageCapture> capture;
+  std::string basePath;
+  int frameCount = 0;
+  int nextFrame = 0;
+  bool frameStarted = false; // nextFrame's time is set and its accumulation begun
+  int framesWritten = 0;
+  int failed = 0;
+  int peakBacklog = 0;
+  std::chrono::steady_clock::time_point startClock, endClock;
+
+  // viewport settings restored at the end
+  struct ViewportSettings {
+    bool progressive, alwaysRender;
+    int progressiveMaxSamples;
+    float fixedTime;
+  } saved;
+
+  std::string framePath(int frame) const;
+  void collect();
+  void finish(Viewport& viewport);
+};
+
+#endif
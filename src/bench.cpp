@@ -0,0 +1,339 @@
+// Headless benchmark: renders a project through Viewport::render on an offscreen
+// EGL context and prints the timings as JSON. Logs go to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <imgui.h>
+
+#include "animation_export.hpp"
+#include "cpu_renderer.hpp"
+#include "node_graph.hpp"
+#include "projectdata.hpp"
+#include "scene.hpp"
+#include "sdf_tape.hpp"
+#include "tiled_render.hpp"
+#include "viewport.hpp"
+
+struct BenchOptions {
+  std::string project;
+  int warmupFrames = 30;
+  int frames = 120;
+  int width = 1280;
+  int height = 720;
+  float time = 0.0f;
+  bool shaderCache = true;
+  bool software = false;
+  bool cpu = false;      // also render on the CPU and compare with the GPU image
+  std::string output;    // where the CPU image is saved
+  std::string animation; // base path of an image sequence from --time to --end
+  float end = 1.0f;
+  float fps = 30.0f;
+  int samples = 16;  // per animation frame and tiled render pixel
+  std::string tiled; // where a tiled render of --tiled-size is saved
+  int tiledWidth = 16384;
+  int tiledHeight = 16384;
+};
+
+void printUsage() {
+  std::cerr << "Usage: 3drme-bench <project.prj> [--warmup N] [--frames N] [--size WxH] [--time T] [--no-shader-cache] [--software] [--cpu] [--output FILE] [--animation PATH] [--end T] [--fps N] [--samples N] [--tiled FILE] [--tiled-size WxH]\n";
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--warmup" && hasValue) {
+      options.warmupFrames = std::max(std::atoi(argv[++i]), 0);
+    } else if (arg == "--frames" && hasValue) {
+      options.frames = std::max(std::atoi(argv[++i]), 1);
+    } else if (arg == "--size" && hasValue) {
+      if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+        return false;
+    } else if (arg == "--time" && hasValue) {
+      options.time = std::max(static_cast<float>(std::atof(argv[++i])), 0.0f);
+    } else if (arg == "--no-shader-cache") {
+      options.shaderCache = false;
+    } else if (arg == "--software") {
+      options.software = true;
+    } else if (arg == "--cpu") {
+      options.cpu = true;
+    } else if (arg == "--output" && hasValue) {
+      options.output = argv[++i];
+      options.cpu = true;
+    } else if (arg == "--animation" && hasValue) {
+      options.animation = argv[++i];
+    } else if (arg == "--end" && hasValue) {
+      options.end = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--fps" && hasValue) {
+      options.fps = std::max(static_cast<float>(std::atof(argv[++i])), 1.0f);
+    } else if (arg == "--samples" && hasValue) {
+      options.samples = std::max(std::atoi(argv[++i]), 1);
+    } else if (arg == "--tiled" && hasValue) {
+      options.tiled = argv[++i];
+    } else if (arg == "--tiled-size" && hasValue) {
+      if (std::sscanf(argv[++i], "%dx%d", &options.tiledWidth, &options.tiledHeight) != 2 || options.tiledWidth <= 0 || options.tiledHeight <= 0)
+        return false;
+    } else if (!arg.starts_with("--") && options.project.empty()) {
+      options.project = arg;
+    } else {
+      return false;
+    }
+  }
+  return !options.project.empty();
+}
+
+// GL 4.3 core without any surface, Mesa picks llvmpipe when there is no GPU
+bool initializeContext(bool software, EGLDisplay& display) {
+  if (software)
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+  display = EGL_NO_DISPLAY;
+  auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (getPlatformDisplay != nullptr)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major = 0, minor = 0;
+  if (display == EGL_NO_DISPLAY || eglInitialize(display, &major, &minor) == EGL_FALSE) {
+    std::cerr << "[Bench] Failed to initialize EGL\n";
+    return false;
+  }
+  eglBindAPI(EGL_OPENGL_API);
+
+  EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint numConfigs = 0;
+  eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+  if (numConfigs == 0)
+    config = nullptr; // EGL_NO_CONFIG_KHR, fine for a surfaceless context
+
+  EGLint contextAttribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, 4, EGL_CONTEXT_MINOR_VERSION_KHR, 3, EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR, EGL_NONE,
+  };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+  if (context == EGL_NO_CONTEXT || eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_FALSE) {
+    std::cerr << "[Bench] Failed to create a surfaceless OpenGL 4.3 context\n";
+    return false;
+  }
+
+  if (gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)) == 0) {
+    std::cerr << "[Bench] Failed to initialize GLAD\n";
+    return false;
+  }
+  return true;
+}
+
+void destroyContext(EGLDisplay display) {
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglTerminate(display); // also destroys the context, which is no longer current
+}
+
+std::string jsonString(const std::string& value) {
+  std::string escaped = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    if (c == '\n')
+      escaped += "\\n";
+    else if (static_cast<unsigned char>(c) >= 0x20)
+      escaped += c;
+  }
+  return escaped + "\"";
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  // only the JSON result goes to stdout
+  std::streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+  EGLDisplay display;
+  if (!initializeContext(options.software, display))
+    return 1;
+
+  // the node editor keeps node positions in an imgui-node-editor context, no UI is drawn
+  ImGui::CreateContext();
+  Shader::binaryCache = options.shaderCache;
+
+  int result = 0;
+  {
+    ProjectData pd;
+    Scene scene;
+    NodeEditor nodeEditor;
+    Viewport viewport(nullptr, &scene, &nodeEditor);
+
+    pd.loadProjectFile(scene, viewport, nodeEditor, options.project);
+    if (!pd.hasLoadedProjectFile()) {
+      result = 1;
+    } else {
+      using clock = std::chrono::steady_clock;
+      using ms = std::chrono::duration<double, std::milli>;
+
+      auto start = clock::now();
+      GlslCode glsl;
+      nodeEditor.generateGlslCode(glsl);
+      viewport.shader.resetFshSource();
+      inlineGlslCode(glsl, viewport.shader.fshEdited);
+      double codegenMs = ms(clock::now() - start).count();
+
+      start = clock::now();
+      viewport.shader.reloadFragment();
+      while (viewport.shader.isCompiling()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        viewport.shader.update();
+      }
+      double compileMs = ms(clock::now() - start).count();
+
+      // the CPU image is compared at full resolution
+      if (options.cpu)
+        viewport.downscaleFactor = 0.0f;
+      viewport.resize(options.width, options.height);
+      viewport.fixedTime = options.time;
+      viewport.alwaysRender = true;
+
+      for (int i = 0; i < options.warmupFrames; i++) {
+        viewport.render();
+        glFinish();
+      }
+
+      std::vector<double> frameMs;
+      frameMs.reserve(options.frames);
+      for (int i = 0; i < options.frames; i++) {
+        start = clock::now();
+        viewport.render();
+        glFinish();
+        frameMs.push_back(ms(clock::now() - start).count());
+      }
+
+      std::sort(frameMs.begin(), frameMs.end());
+      double sum = 0.0;
+      for (double frame : frameMs)
+        sum += frame;
+      auto p99 = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(frameMs.size()))) - 1;
+
+      // CPU distance throughput of one thread, over points around the origin
+      SdfTape tape;
+      double pointsPerSec = 0.0;
+      if (compileSdfTape(nodeEditor.getNodes(), tape)) {
+        const size_t points = size_t(1) << 20;
+        std::vector<float> x(points), y(points), z(points), distances(points);
+        for (size_t i = 0; i < points; i++) {
+          // golden ratio sequence, deterministic so runs are comparable
+          auto t = static_cast<double>(i);
+          x[i] = static_cast<float>(8.0 * (std::fmod(t * 0.618034, 1.0) - 0.5));
+          y[i] = static_cast<float>(8.0 * (std::fmod(t * 0.754878, 1.0) - 0.5));
+          z[i] = static_cast<float>(8.0 * (std::fmod(t * 0.569840, 1.0) - 0.5));
+        }
+        tape.evaluate(x.data(), y.data(), z.data(), distances.data(), points, options.time);
+        start = clock::now();
+        tape.evaluate(x.data(), y.data(), z.data(), distances.data(), points, options.time);
+        pointsPerSec = static_cast<double>(points) / std::chrono::duration<double>(clock::now() - start).count();
+      }
+
+      // the same view on the CPU, compared with the last GPU frame in 8 bit
+      CpuRenderer cpuRenderer;
+      bool cpuRendered = false;
+      double meanDiff = 0.0;
+      int maxDiff = 0;
+      if (options.cpu && cpuRenderer.render(viewport, viewport.width, viewport.height, options.time)) {
+        cpuRendered = true;
+        std::vector<unsigned char> gpuImage(cpuRenderer.image.size());
+        viewport.taaFramebuffer.bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, viewport.width, viewport.height, GL_RGB, GL_UNSIGNED_BYTE, gpuImage.data());
+        viewport.taaFramebuffer.unbind();
+
+        long long sum = 0;
+        for (size_t i = 0; i < gpuImage.size(); i++) {
+          int diff = std::abs(static_cast<int>(gpuImage[i]) - static_cast<int>(cpuRenderer.image[i]));
+          sum += diff;
+          maxDiff = std::max(maxDiff, diff);
+        }
+        meanDiff = static_cast<double>(sum) / static_cast<double>(std::max<size_t>(gpuImage.size(), 1));
+        if (!options.output.empty())
+          cpuRenderer.saveImage(options.output);
+      }
+
+      // the sequence as the UI exports it, throughput with readbacks and encoding overlapped
+      AnimationExporter animationExporter;
+      if (!options.animation.empty()) {
+        animationExporter.startTime = options.time;
+        animationExporter.endTime = std::max(options.end, options.time);
+        animationExporter.fps = options.fps;
+        animationExporter.samples = options.samples;
+        viewport.alwaysRender = false;
+        animationExporter.start(viewport, options.animation);
+        while (animationExporter.isRunning()) {
+          animationExporter.update(viewport, 1000.0);
+          if (animationExporter.getFramesRendered() == animationExporter.getFrameCount())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+
+      TiledRenderer tiledRenderer;
+      bool tiledRendered = false;
+      if (!options.tiled.empty()) {
+        tiledRenderer.width = options.tiledWidth;
+        tiledRenderer.height = options.tiledHeight;
+        tiledRenderer.samples = options.samples;
+        tiledRendered = tiledRenderer.render(viewport, options.tiled, options.time);
+      }
+
+      const std::string& error = viewport.shader.getFragError();
+      result = error.empty() ? 0 : 1;
+
+      std::cout.rdbuf(stdoutBuffer);
+      std::cout << "{";
+      std::cout << "\"project\":" << jsonString(options.project);
+      std::cout << ",\"renderer\":" << jsonString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+      std::cout << ",\"width\":" << viewport.width << ",\"height\":" << viewport.height;
+      std::cout << ",\"render_width\":" << viewport.renderWidth << ",\"render_height\":" << viewport.renderHeight;
+      std::cout << ",\"objects\":" << scene.sceneTree.size();
+      std::cout << ",\"time\":" << options.time;
+      std::cout << ",\"warmup_frames\":" << options.warmupFrames << ",\"frames\":" << options.frames;
+      std::cout << ",\"codegen_ms\":" << codegenMs;
+      std::cout << ",\"shader_compile_ms\":" << compileMs << ",\"shader_cache\":" << (options.shaderCache ? "true" : "false");
+      std::cout << ",\"frame_ms\":{\"avg\":" << sum / static_cast<double>(frameMs.size()) << ",\"min\":" << frameMs.front() << ",\"p99\":" << frameMs[p99] << ",\"max\":" << frameMs.back() << "}";
+      if (tape.isValid())
+        std::cout << ",\"cpu_sdf\":{\"instructions\":" << tape.getInstructionCount() << ",\"registers\":" << tape.getRegisterCount() << ",\"points_per_sec\":" << pointsPerSec << "}";
+      else
+        std::cout << ",\"cpu_sdf\":null";
+      if (cpuRendered)
+        std::cout << ",\"cpu_render\":{\"ms\":" << cpuRenderer.renderMs << ",\"threads\":" << cpuRenderer.renderThreads << ",\"mean_abs_diff\":" << meanDiff << ",\"max_abs_diff\":" << maxDiff << "}";
+      else if (options.cpu)
+        std::cout << ",\"cpu_render\":null";
+      if (!options.animation.empty())
+        std::cout << ",\"animation\":{\"frames\":" << animationExporter.getFrameCount() << ",\"samples\":" << animationExporter.samples << ",\"written\":" << animationExporter.getFramesWritten() - animationExporter.getFailed() << ",\"seconds\":" << animationExporter.getSeconds() << ",\"frames_per_sec\":" << animationExporter.getFramesPerSecond() << ",\"peak_backlog\":" << animationExporter.getPeakBacklog() << "}";
+      if (tiledRendered)
+        std::cout << ",\"tiled_render\":{\"width\":" << tiledRenderer.width << ",\"height\":" << tiledRenderer.height << ",\"tile\":" << tiledRenderer.tileSize << ",\"samples\":" << tiledRenderer.samples << ",\"ms\":" << tiledRenderer.renderMs << ",\"peak_bytes\":" << tiledRenderer.peakBytes << "}";
+      else if (!options.tiled.empty())
+        std::cout << ",\"tiled_render\":null";
+      if (!error.empty())
+        std::cout << ",\"error\":" << jsonString(error);
+      std::cout << "}" << std::endl;
+    }
+  }
+
+  std::cout.rdbuf(stdoutBuffer); // not restored yet if the project failed to load
+  ImGui::DestroyContext();
+  destroyContext(display);
+  return result;
+}
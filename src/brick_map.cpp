@@ -0,0 +1,291 @@
+#include "brick_map.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "sdf_tape.hpp"
+
+namespace {
+
+constexpr int brickVolume = BrickMap::brickSamples * BrickMap::brickSamples * BrickMap::brickSamples;
+constexpr int gridVolume = BrickMap::gridBricks * BrickMap::gridBricks * BrickMap::gridBricks;
+
+void combine(size_t& seed, size_t value) { seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2); }
+
+// code nodes don't get this far, they have no CPU tape
+bool subgraphUsesTime(const Pin* pin) {
+  const Node* node = pin->node;
+  if (node->getType() == NodeType::InputTime)
+    return true;
+  for (const auto& input : node->getInputs()) {
+    for (const Pin* p : input.pins) {
+      if (subgraphUsesTime(p))
+        return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+size_t subgraphHash(const Pin* pin) {
+  const Node* node = pin->node;
+  size_t seed = std::hash<int>{}(static_cast<int>(node->getType()));
+  combine(seed, pin - node->getOutputs().data());
+  combine(seed, std::hash<std::string>{}(node->code));
+  for (float x : node->data)
+    combine(seed, std::hash<float>{}(x));
+  for (const auto& input : node->getInputs()) {
+    combine(seed, input.pins.size());
+    for (const Pin* p : input.pins)
+      combine(seed, subgraphHash(p));
+  }
+  return seed;
+}
+
+size_t BrickMap::Volume::getBytes() const { return samples.size() * sizeof(uint16_t) + index.size() * sizeof(uint32_t); }
+
+BrickMap::~BrickMap() {
+  if (atlas != 0)
+    glDeleteTextures(1, &atlas);
+  if (indexTexture != 0)
+    glDeleteTextures(1, &indexTexture);
+}
+
+bool BrickMap::bake(const Node& node) {
+  auto start = std::chrono::steady_clock::now();
+  if (!node.isSurface())
+    return false;
+
+  const Pin* pin = &node.getOutputs()[0];
+  glm::vec4 bound;
+  if (!surfaceBound(pin, bound) || bound.w <= 0.0f) {
+    std::cerr << "[Brick map] Node " << node.getIdLong() << " has no bounds, only bounded surfaces can be baked\n";
+    return false;
+  }
+  if (subgraphUsesTime(pin)) {
+    std::cerr << "[Brick map] Node " << node.getIdLong() << " changes over time and can't be baked\n";
+    return false;
+  }
+  SdfTape tape;
+  if (!compileSdfTape(pin, tape))
+    return false;
+
+  remove(node.getIdLong());
+  if (volumes.size() >= maxVolumes) {
+    std::cerr << "[Brick map] Node " << node.getIdLong() << " can't be baked, the index has room for " << maxVolumes << " volumes\n";
+    return false;
+  }
+
+  Volume volume;
+  volume.nodeId = node.getIdLong();
+  volume.graphHash = subgraphHash(pin);
+  volume.exactInstructions = tape.getInstructionCount();
+  volume.margin = 0.125f * bound.w;
+  float halfSize = bound.w + volume.margin;
+  volume.cellSize = 2.0f * halfSize / static_cast<float>(gridBricks * (brickSamples - 1));
+  volume.origin = glm::vec3(bound) - halfSize;
+
+  // a brick is sampled if the surface can pass through it, with a cell to spare for interpolation
+  float brickSize = volume.cellSize * static_cast<float>(brickSamples - 1);
+  std::vector<float> x(gridVolume), y(gridVolume), z(gridVolume), centers(gridVolume);
+  for (int i = 0; i < gridVolume; i++) {
+    glm::vec3 p = volume.origin + (glm::vec3(i % gridBricks, i / gridBricks % gridBricks, i / (gridBricks * gridBricks)) + 0.5f) * brickSize;
+    x[i] = p.x;
+    y[i] = p.y;
+    z[i] = p.z;
+  }
+  tape.evaluate(x.data(), y.data(), z.data(), centers.data(), gridVolume);
+
+  float keepDist = 0.5f * std::sqrt(3.0f) * brickSize + volume.cellSize;
+  std::vector<int> bricks;
+  volume.index.assign(gridVolume, 0);
+  for (int i = 0; i < gridVolume; i++) {
+    if (std::abs(centers[i]) <= keepDist) {
+      bricks.push_back(i);
+      volume.index[i] = static_cast<uint32_t>(bricks.size());
+    }
+  }
+
+  size_t brickCount = bricks.size();
+  for (const auto& v : volumes)
+    brickCount += v.getBrickCount();
+  if (brickCount > maxBricks) {
+    std::cerr << "[Brick map] Node " << volume.nodeId << " needs " << bricks.size() << " bricks, the atlas has room for " << maxBricks << " in total\n";
+    return false;
+  }
+
+  // bricks are handed out to the workers one by one
+  volume.samples.resize(bricks.size() * brickVolume);
+  std::atomic<size_t> nextBrick{0};
+  auto worker = [&] {
+    std::vector<float> bx(brickVolume), by(brickVolume), bz(brickVolume);
+    for (size_t b = nextBrick++; b < bricks.size(); b = nextBrick++) {
+      int i = bricks[b];
+      glm::vec3 corner = volume.origin + glm::vec3(i % gridBricks, i / gridBricks % gridBricks, i / (gridBricks * gridBricks)) * brickSize;
+      for (int s = 0; s < brickVolume; s++) {
+        glm::vec3 p = corner + glm::vec3(s % brickSamples, s / brickSamples % brickSamples, s / (brickSamples * brickSamples)) * volume.cellSize;
+        bx[s] = p.x;
+        by[s] = p.y;
+        bz[s] = p.z;
+      }
+      tape.evaluate(bx.data(), by.data(), bz.data(), volume.samples.data() + b * brickVolume, brickVolume);
+    }
+  };
+  int threadCount = threads > 0 ? threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threadCount; i++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& t : workers)
+    t.join();
+
+  volume.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "[Brick map] Baked node " << volume.nodeId << ": " << bricks.size() << " of " << gridVolume << " bricks, " << volume.getBytes() / 1024
+            << " KiB in " << volume.bakeMs << " ms. Near the surface a lookup replaces " << volume.exactInstructions << " instructions per evaluation\n";
+
+  volumes.push_back(std::move(volume));
+  dirty = true;
+  return true;
+}
+
+void BrickMap::remove(unsigned long nodeId) {
+  auto it = std::find_if(volumes.begin(), volumes.end(), [&](const Volume& v) { return v.nodeId == nodeId; });
+  if (it == volumes.end())
+    return;
+  volumes.erase(it);
+  dirty = true;
+}
+
+void BrickMap::clear() {
+  dirty = dirty || !volumes.empty();
+  volumes.clear();
+}
+
+bool BrickMap::validate(const std::vector<std::unique_ptr<Node>>& nodes) {
+  size_t count = volumes.size();
+  std::erase_if(volumes, [&](const Volume& volume) {
+    auto it = std::find_if(nodes.begin(), nodes.end(), [&](const auto& node) { return node->getIdLong() == volume.nodeId; });
+    if (it == nodes.end()) {
+      std::cout << "[Brick map] Dropped the volume of node " << volume.nodeId << ", the node was deleted\n";
+      return true;
+    }
+    if (subgraphHash(&(*it)->getOutputs()[0]) == volume.graphHash)
+      return false;
+    std::cout << "[Brick map] Dropped the volume of node " << volume.nodeId << ", its subgraph changed\n";
+    return true;
+  });
+  dirty = dirty || volumes.size() != count;
+  return volumes.size() != count;
+}
+
+void BrickMap::upload() {
+  dirty = false;
+  if (volumes.empty())
+    return;
+
+  if (atlas == 0) {
+    glGenTextures(1, &atlas);
+    glGenTextures(1, &indexTexture);
+  }
+
+  // slots are numbered through the atlas row by row, layer by layer
+  size_t brickCount = 0;
+  for (const auto& volume : volumes)
+    brickCount += volume.getBrickCount();
+  size_t layerBricks = atlasBricks * atlasBricks;
+  int size = atlasBricks * brickSamples;
+  int depth = static_cast<int>(std::max<size_t>((brickCount + layerBricks - 1) / layerBricks, 1)) * brickSamples;
+  std::vector<float> atlasData(static_cast<size_t>(size) * size * depth, 0.0f);
+  std::vector<uint32_t> indexData(static_cast<size_t>(gridVolume) * volumes.size(), 0);
+
+  size_t slot = 0;
+  for (size_t v = 0; v < volumes.size(); v++) {
+    const Volume& volume = volumes[v];
+    for (int i = 0; i < gridVolume; i++) {
+      if (volume.index[i] != 0)
+        indexData[v * gridVolume + i] = static_cast<uint32_t>(slot + volume.index[i]);
+    }
+    for (size_t b = 0; b < volume.getBrickCount(); b++, slot++) {
+      size_t sx = slot % atlasBricks * brickSamples;
+      size_t sy = slot / atlasBricks % atlasBricks * brickSamples;
+      size_t sz = slot / layerBricks * brickSamples;
+      const float* samples = volume.samples.data() + b * brickVolume;
+      for (int k = 0; k < brickSamples; k++) {
+        for (int j = 0; j < brickSamples; j++) {
+          float* row = atlasData.data() + ((sz + k) * size + sy + j) * size + sx;
+          std::copy_n(samples + (k * brickSamples + j) * brickSamples, brickSamples, row);
+        }
+      }
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_3D, atlas);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, size, size, depth, 0, GL_RED, GL_FLOAT, atlasData.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  glBindTexture(GL_TEXTURE_3D, indexTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_R32UI, gridBricks, gridBricks, gridBricks * static_cast<int>(volumes.size()), 0, GL_RED_INTEGER, GL_UNSIGNED_INT,
+               indexData.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  std::cout << "[Brick map] Uploaded " << volumes.size() << " volumes, " << brickCount << " bricks, " << getBytes() / 1024 << " KiB\n";
+}
+
+void BrickMap::bind() {
+  if (dirty)
+    upload();
+  if (atlas == 0)
+    return;
+
+  glActiveTexture(GL_TEXTURE0 + atlasUnit);
+  glBindTexture(GL_TEXTURE_3D, atlas);
+  glActiveTexture(GL_TEXTURE0 + indexUnit);
+  glBindTexture(GL_TEXTURE_3D, indexTexture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+const BrickMap::Volume* BrickMap::find(const Node& node) const {
+  for (const auto& volume : volumes) {
+    if (volume.nodeId == node.getIdLong())
+      return &volume;
+  }
+  return nullptr;
+}
+
+VolumeGlsl BrickMap::lookupGlsl(const Node& node) const {
+  VolumeGlsl glsl;
+  const Volume* volume = find(node);
+  if (volume == nullptr)
+    return glsl;
+
+  // outside the volume the bounding sphere is close enough, inside it bricks that were left out
+  // fall back to the exact code. Each distance is declared once, tb<pin> and tv<pin>
+  int z0 = static_cast<int>(volume - volumes.data()) * gridBricks;
+  const glm::vec3& o = volume->origin;
+  glsl.temps = std::format("float tb{{0}}=boundDist(pos,{});\nfloat tv{{0}}=tb{{0}}>{:#}?tb{{0}}:brickDist(pos,vec4({:#},{:#},{:#},{:#}),{});\n",
+                           node.getBoundOffset(), volume->margin, o.x, o.y, o.z, volume->cellSize, z0);
+  glsl.code = "(tv{0}<FLOAT_MAX?tv{0}:{1})";
+  return glsl;
+}
+
+const std::vector<BrickMap::Volume>& BrickMap::getVolumes() const { return volumes; }
+
+size_t BrickMap::getBytes() const {
+  size_t bytes = 0;
+  for (const auto& volume : volumes)
+    bytes += volume.getBytes();
+  return bytes;
+}
@@ -0,0 +1,83 @@
+#ifndef BRICK_MAP_H
+#define BRICK_MAP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "nodes.hpp"
+
+// Surface subgraphs sampled on the CPU into a sparse brick map, so the distance variant of the
+// shader can replace them with a trilinear texture lookup. Each baked node gets a volume of
+// gridBricks^3 bricks around its bounding sphere. Only bricks the surface passes through are
+// sampled, their samples go to a shared 3D atlas and uBrickIndex maps every brick of a volume to
+// its atlas slot. Away from the surface the exact code still runs (brickDist in main.fsh).
+class BrickMap {
+public:
+  static constexpr GLuint atlasUnit = 2; // texture units of uBrickAtlas and uBrickIndex
+  static constexpr GLuint indexUnit = 3;
+
+  // match the BRICK_* defines in main.fsh
+  static constexpr int brickSamples = 8; // per axis, neighbouring bricks both hold the layer between them
+  static constexpr int gridBricks = 32;  // per axis of a volume
+  static constexpr int atlasBricks = 16; // atlas width and height in bricks
+  static constexpr size_t maxBricks = atlasBricks * atlasBricks * 256; // 2048 atlas layers, the GL 4.3 minimum
+  static constexpr size_t maxVolumes = 2048 / gridBricks;             // index texture layers, the same minimum
+
+  struct Volume {
+    unsigned long nodeId;
+    size_t graphHash;          // subgraph at bake time, the bake is dropped once it changes
+    glm::vec3 origin;          // min corner
+    float cellSize;            // distance between samples
+    float margin;              // the volume covers the bounding sphere grown by this much
+    std::vector<uint32_t> index; // gridBricks^3, slot in samples + 1, 0 for bricks left out
+    std::vector<float> samples;  // brickSamples^3 per brick
+    size_t exactInstructions;    // CPU tape size of the subgraph, a measure of its GLSL cost
+    double bakeMs;
+
+    size_t getBrickCount() const { return samples.size() / (brickSamples * brickSamples * brickSamples); }
+    size_t getBytes() const; // GPU memory, R16F samples and R32UI index
+  };
+
+  int threads = 0; // 0: one per hardware thread
+
+  BrickMap() = default;
+  BrickMap(const BrickMap&) = delete;
+  BrickMap& operator=(const BrickMap&) = delete;
+  ~BrickMap();
+
+  // false if the node's surface is unbounded, animated or uses code nodes
+  bool bake(const Node& node);
+  void remove(unsigned long nodeId);
+  void clear();
+
+  // drops volumes whose node was deleted or whose subgraph changed, true if any were dropped
+  bool validate(const std::vector<std::unique_ptr<Node>>& nodes);
+
+  // uploads the volumes after changes and binds the textures
+  void bind();
+
+  const Volume* find(const Node& node) const;
+  // distance code replacing node in the distance variant
+  VolumeGlsl lookupGlsl(const Node& node) const;
+
+  const std::vector<Volume>& getVolumes() const;
+  size_t getBytes() const;
+
+private:
+  std::vector<Volume> volumes;
+  GLuint atlas = 0;
+  GLuint indexTexture = 0;
+  bool dirty = false;
+
+  void upload();
+};
+
+// hash of a subgraph: node types, parameters, code and links above pin
+size_t subgraphHash(const Pin* pin);
+
+#endif
@@ -0,0 +1,152 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode must match the std430 layout in main.fsh");
+
+Bvh::Bvh() {
+  glGenBuffers(1, &nodeSsbo);
+  glGenBuffers(1, &objectSsbo);
+}
+
+Bvh::~Bvh() {
+  glDeleteBuffers(1, &nodeSsbo);
+  glDeleteBuffers(1, &objectSsbo);
+}
+
+void Bvh::update(const std::vector<glm::vec4>& bounds) {
+  if (nodes.empty() || objects.size() != bounds.size()) {
+    build(bounds);
+    return;
+  }
+
+  refit(bounds);
+
+  // objects moved far from where they were when the tree was built
+  if (innerArea() > 2.0f * builtArea)
+    build(bounds);
+}
+
+void Bvh::build(const std::vector<glm::vec4>& bounds) {
+  built = true;
+  objects.resize(bounds.size());
+  std::iota(objects.begin(), objects.end(), 0);
+
+  nodes.clear();
+  nodes.emplace_back();
+
+  if (bounds.empty()) {
+    // inverted box, never visited
+    nodes[0] = {glm::vec3(std::numeric_limits<float>::max()), 0, glm::vec3(-std::numeric_limits<float>::max()), 0};
+    builtArea = 0.0f;
+    return;
+  }
+
+  int depth = buildRange(bounds, 0, 0, static_cast<int>(bounds.size()));
+  builtArea = innerArea();
+  std::cout << "[Scene] Built BVH: " << nodes.size() << " nodes, depth " << depth << "\n";
+}
+
+void fitLeaf(BvhNode& node, const std::vector<int>& objects, const std::vector<glm::vec4>& bounds, int first, int count) {
+  node.aabbMin = glm::vec3(std::numeric_limits<float>::max());
+  node.aabbMax = glm::vec3(-std::numeric_limits<float>::max());
+  for (int i = first; i < first + count; i++) {
+    const glm::vec4& b = bounds[objects[i]];
+    node.aabbMin = glm::min(node.aabbMin, glm::vec3(b) - b.w);
+    node.aabbMax = glm::max(node.aabbMax, glm::vec3(b) + b.w);
+  }
+}
+
+int Bvh::buildRange(const std::vector<glm::vec4>& bounds, int node, int first, int count) {
+  fitLeaf(nodes[node], objects, bounds, first, count);
+  if (count <= maxLeafSize) {
+    nodes[node].first = first;
+    nodes[node].count = count;
+    return 1;
+  }
+
+  // split at the median center along the longest axis
+  glm::vec3 centerMin = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 centerMax = glm::vec3(-std::numeric_limits<float>::max());
+  for (int i = first; i < first + count; i++) {
+    centerMin = glm::min(centerMin, glm::vec3(bounds[objects[i]]));
+    centerMax = glm::max(centerMax, glm::vec3(bounds[objects[i]]));
+  }
+  glm::vec3 extent = centerMax - centerMin;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+  int half = count / 2;
+  auto begin = objects.begin() + first;
+  std::nth_element(begin, begin + half, begin + count, [&](int a, int b) { return bounds[a][axis] < bounds[b][axis]; });
+
+  int left = static_cast<int>(nodes.size());
+  nodes.emplace_back();
+  nodes.emplace_back();
+  nodes[node].first = left;
+  nodes[node].count = 0;
+
+  int leftDepth = buildRange(bounds, left, first, half);
+  int rightDepth = buildRange(bounds, left + 1, first + half, count - half);
+  return 1 + std::max(leftDepth, rightDepth);
+}
+
+void Bvh::refit(const std::vector<glm::vec4>& bounds) {
+  if (objects.empty())
+    return;
+
+  // children are always stored after their parent
+  for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+    BvhNode& node = nodes[i];
+    BvhNode old = node;
+    if (node.count > 0) {
+      fitLeaf(node, objects, bounds, node.first, node.count);
+    } else {
+      const BvhNode& l = nodes[node.first];
+      const BvhNode& r = nodes[node.first + 1];
+      node.aabbMin = glm::min(l.aabbMin, r.aabbMin);
+      node.aabbMax = glm::max(l.aabbMax, r.aabbMax);
+    }
+    if (node.aabbMin != old.aabbMin || node.aabbMax != old.aabbMax) {
+      refitFirst = std::min(refitFirst, static_cast<size_t>(i));
+      refitEnd = std::max(refitEnd, static_cast<size_t>(i) + 1);
+    }
+  }
+}
+
+float Bvh::innerArea() const {
+  float area = 0.0f;
+  for (const auto& node : nodes) {
+    if (node.count > 0)
+      continue;
+    glm::vec3 e = glm::max(node.aabbMax - node.aabbMin, glm::vec3(0.0f));
+    area += 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+  return area;
+}
+
+void Bvh::upload() {
+  if (built) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(nodes.size() * sizeof(BvhNode)), nodes.data(), GL_DYNAMIC_DRAW);
+
+    // an empty buffer can't be bound
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(objects.size(), 1) * sizeof(int)), objects.empty() ? nullptr : objects.data(), GL_DYNAMIC_DRAW);
+  } else if (refitFirst < refitEnd) {
+    // a refit keeps the sizes and the object list
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeSsbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(refitFirst * sizeof(BvhNode)), static_cast<GLsizeiptr>((refitEnd - refitFirst) * sizeof(BvhNode)),
+                    &nodes[refitFirst]);
+  }
+  built = false;
+  refitFirst = std::numeric_limits<size_t>::max();
+  refitEnd = 0;
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, nodeBinding, nodeSsbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, objectBinding, objectSsbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,54 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+// std430 layout, matches BvhNode in main.fsh
+struct BvhNode {
+  glm::vec3 aabbMin;
+  int first; // leaf: first entry in the object list, inner node: left child (right child follows it)
+  glm::vec3 aabbMax;
+  int count; // objects in a leaf, 0 for inner nodes
+};
+
+// Bounding volume hierarchy over scene objects, traversed by sceneSdf in main.fsh.
+// Built with median splits so the depth stays within the shader's traversal stack.
+// Moving objects only refit the boxes, a full rebuild happens when the object count
+// changes or refitting has made the tree too loose.
+class Bvh {
+public:
+  static constexpr GLuint nodeBinding = 2;
+  static constexpr GLuint objectBinding = 3;
+  static constexpr int maxLeafSize = 2;
+
+  std::vector<BvhNode> nodes;
+  std::vector<int> objects; // object indices referenced by leaves
+
+  Bvh();
+  ~Bvh();
+
+  // bounds are bounding spheres (center, radius), one per object
+  void update(const std::vector<glm::vec4>& bounds);
+  // respecifies the buffers after a build, after a refit only the nodes whose boxes changed are sent
+  void upload();
+
+private:
+  GLuint nodeSsbo;
+  GLuint objectSsbo;
+  float builtArea = 0.0f; // summed inner node surface area right after the last build
+  bool built = false;     // since the last upload
+  size_t refitFirst = std::numeric_limits<size_t>::max(), refitEnd = 0; // nodes changed by refits since the last upload
+
+  void build(const std::vector<glm::vec4>& bounds);
+  void refit(const std::vector<glm::vec4>& bounds);
+  int buildRange(const std::vector<glm::vec4>& bounds, int node, int first, int count);
+  float innerArea() const;
+};
+
+#endif
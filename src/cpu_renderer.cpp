@@ -0,0 +1,435 @@
+#include "cpu_renderer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include <stb_image_write.h>
+
+namespace {
+
+constexpr float floatMax = 1e10f; // FLOAT_MAX
+
+// Surface of main.fsh
+struct SurfaceSample {
+  float dist;
+  glm::vec3 color;
+  float selected;
+  float roughness;
+};
+
+unsigned char toByte(float c) { return static_cast<unsigned char>(std::lround(glm::clamp(c, 0.0f, 1.0f) * 255.0f)); }
+
+} // namespace
+
+// sample points in the layout SdfTape::evaluate takes
+struct CpuRenderer::Points {
+  std::vector<float> x, y, z;
+
+  size_t size() const { return x.size(); }
+  void resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  }
+  void set(size_t i, const glm::vec3& p) {
+    x[i] = p.x;
+    y[i] = p.y;
+    z[i] = p.z;
+  }
+  glm::vec3 get(size_t i) const { return {x[i], y[i], z[i]}; }
+};
+
+bool CpuRenderer::render(const Viewport& viewport, int w, int h, float time) {
+  auto start = std::chrono::steady_clock::now();
+
+  const auto& nodes = viewport.nodeEditor->getNodes();
+  glm::vec3 ambient = viewport.ambientIntensity * viewport.ambientColor;
+  sceneSdf.time = time;
+  if (!sceneSdf.load(*viewport.nodeEditor, *viewport.scene) || !compileSurfaceTape(nodes, surfaceTape) || !compileSkyTape(nodes, ambient, skyTape) || !compileLightsTape(nodes, lightsTape, lights)) {
+    std::cerr << "[CPU renderer] The node graph can't be rendered on the CPU\n";
+    return false;
+  }
+
+  // as in Viewport::getRenderState
+  settings.raymarchSteps = viewport.raymarchSteps;
+  settings.reflRaymarchSteps = viewport.reflRaymarchSteps;
+  settings.fogFadeIn = viewport.fogFadeIn;
+  settings.occlusionParams = glm::vec2(viewport.occlusionFactor, viewport.occlusionRadius);
+  settings.ambientColor = ambient;
+  settings.proj = viewport.camera.getProjVec();
+  settings.camTarget = viewport.camera.target;
+  settings.raymarchParams = glm::vec3(viewport.raymarchingClipStart, viewport.raymarchingClipEnd, viewport.raymarchingPixelRadius);
+  settings.viewRot = viewport.camera.getViewRotMat();
+
+  width = w;
+  height = h;
+  image.assign(static_cast<size_t>(w) * h * 3, 0);
+
+  int tilesX = (w + tileSize - 1) / tileSize;
+  int tileCount = tilesX * ((h + tileSize - 1) / tileSize);
+  std::atomic<int> nextTile{0};
+  auto worker = [&] {
+    for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+      renderTile(tile % tilesX, tile / tilesX);
+  };
+
+  int threadCount = threads > 0 ? threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threadCount; i++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& t : workers)
+    t.join();
+
+  renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  renderThreads = threadCount;
+  std::cout << "[CPU renderer] Rendered " << w << "x" << h << " on " << threadCount << " threads in " << renderMs << " ms\n";
+  return true;
+}
+
+void CpuRenderer::saveImage(std::string& filePath) const {
+  if (!filePath.ends_with(".png"))
+    filePath += ".png";
+
+  // bottom row first, flipped by a negative stride as the global stbi_flip_vertically_on_write
+  // would race with the capture encoder thread
+  stbi_write_png(filePath.c_str(), width, height, 3, image.data() + static_cast<size_t>(width) * 3 * (height - 1), -width * 3);
+
+  std::cout << "[CPU renderer] Saved render to " << filePath << std::endl;
+}
+
+void CpuRenderer::sceneDistances(const Points& points, std::vector<float>& distances) const {
+  distances.resize(points.size());
+  sceneSdf.evaluate(points.x.data(), points.y.data(), points.z.data(), distances.data(), points.size());
+}
+
+void CpuRenderer::softShadows(const std::vector<glm::vec3>& ro, const std::vector<glm::vec3>& rd, int steps, float mint, const std::vector<float>& maxt,
+                              const std::vector<float>& w, std::vector<float>& res) const {
+  size_t n = ro.size();
+  res.assign(n, 1.0f);
+  std::vector<float> ph(n, 1e20f);
+  std::vector<float> t(n, mint);
+
+  std::vector<size_t> active;
+  for (size_t i = 0; i < n; i++) {
+    if (mint < maxt[i])
+      active.push_back(i);
+  }
+
+  Points points;
+  std::vector<float> distances;
+  for (int step = 0; step < steps && !active.empty(); step++) {
+    points.resize(active.size());
+    for (size_t k = 0; k < active.size(); k++)
+      points.set(k, ro[active[k]] + rd[active[k]] * t[active[k]]);
+    sceneDistances(points, distances);
+
+    size_t kept = 0;
+    for (size_t k = 0; k < active.size(); k++) {
+      size_t i = active[k];
+      float h = distances[k];
+      if (h < 0.01f) {
+        res[i] = 0.0f;
+        continue;
+      }
+      float y = h * h / (2.0f * ph[i]);
+      float d = std::sqrt(h * h - y * y);
+      res[i] = std::min(res[i], d / (w[i] * std::max(0.0f, t[i] - y)));
+      ph[i] = h;
+      t[i] += h;
+      if (t[i] < maxt[i])
+        active[kept++] = i;
+    }
+    active.resize(kept);
+  }
+}
+
+void CpuRenderer::renderTile(int tileX, int tileY) {
+  const int x0 = tileX * tileSize;
+  const int y0 = tileY * tileSize;
+  const int tileWidth = std::min(tileSize, width - x0);
+  const size_t n = static_cast<size_t>(tileWidth) * std::min(tileSize, height - y0);
+
+  const float tmin = settings.raymarchParams.x;
+  const float tmax = settings.raymarchParams.y;
+  const float pixelRadius = settings.raymarchParams.z;
+
+  struct Ray {
+    glm::vec3 ro, rd, pos;
+    float dist, candidateError, previousRadius, stepLength, omega;
+  };
+  std::vector<Ray> rays(n);
+
+  // render() and the start of rayMarch, pixel centers as in gl_FragCoord
+  glm::vec2 resolution(width, height);
+  float fovVal = 1.0f + std::tan(settings.proj.y);
+  for (size_t i = 0; i < n; i++) {
+    glm::vec2 fragCoord(x0 + static_cast<int>(i) % tileWidth, y0 + static_cast<int>(i) / tileWidth);
+    glm::vec2 uv = (fragCoord + 0.5f - resolution * 0.5f) / std::max(resolution.x, resolution.y) * settings.proj.x;
+    glm::vec3 backplane = glm::vec3(uv, -settings.proj.z) * settings.viewRot;
+    glm::vec3 frontplane = glm::vec3(fovVal * uv, -settings.proj.z + 0.5f) * settings.viewRot;
+
+    Ray& r = rays[i];
+    r.ro = backplane - settings.camTarget;
+    r.rd = glm::normalize(frontplane - backplane);
+    r.pos = r.ro;
+    r.dist = tmin;
+    r.candidateError = floatMax;
+    r.previousRadius = 0.0f;
+    r.stepLength = 0.0f;
+    r.omega = 1.2f;
+  }
+
+  // relaxed sphere tracing, rays leave the packet once they are done
+  Points points;
+  std::vector<float> distances;
+  std::vector<size_t> active(n);
+  for (size_t i = 0; i < n; i++)
+    active[i] = i;
+  for (int step = 0; step < settings.raymarchSteps && !active.empty(); step++) {
+    points.resize(active.size());
+    for (size_t k = 0; k < active.size(); k++) {
+      Ray& r = rays[active[k]];
+      r.pos = r.ro + r.rd * r.dist;
+      points.set(k, r.pos);
+    }
+    sceneDistances(points, distances);
+
+    size_t kept = 0;
+    for (size_t k = 0; k < active.size(); k++) {
+      Ray& r = rays[active[k]];
+      float signedRadius = distances[k];
+      float radius = std::abs(signedRadius);
+
+      bool sorFail = r.omega > 1.0f && (radius + r.previousRadius) < r.stepLength;
+      if (sorFail) {
+        r.stepLength -= r.omega * r.stepLength;
+        r.omega = 1.0f;
+      } else {
+        r.stepLength = r.omega * signedRadius;
+      }
+      r.previousRadius = radius;
+
+      float error = radius / r.dist;
+      if (!sorFail && error < r.candidateError)
+        r.candidateError = error;
+      if ((!sorFail && error < pixelRadius) || r.dist > tmax)
+        continue;
+
+      r.dist += r.stepLength;
+      active[kept++] = active[k];
+    }
+    active.resize(kept);
+  }
+
+  // lights at the march position and the sky behind every ray
+  const size_t lightCount = lights.size();
+  std::vector<float> lightValues(lightCount * 8 * n);
+  std::vector<float*> lightOutputs(lightCount * 8);
+  for (size_t i = 0; i < lightOutputs.size(); i++)
+    lightOutputs[i] = &lightValues[i * n];
+  points.resize(n);
+  for (size_t i = 0; i < n; i++)
+    points.set(i, rays[i].pos);
+  if (lightCount > 0)
+    lightsTape.evaluate(points.x.data(), points.y.data(), points.z.data(), lightOutputs, n, sceneSdf.time);
+  auto lightVec3 = [&](size_t light, int first, size_t i) { return glm::vec3(lightOutputs[light * 8 + first][i], lightOutputs[light * 8 + first + 1][i], lightOutputs[light * 8 + first + 2][i]); };
+  auto lightFloat = [&](size_t light, int index, size_t i) { return lightOutputs[light * 8 + index][i]; };
+
+  std::vector<float> sky(3 * n);
+  float* skyOutputs[3] = {&sky[0], &sky[n], &sky[2 * n]};
+  for (size_t i = 0; i < n; i++)
+    points.set(i, rays[i].rd * tmax);
+  skyTape.evaluate(points.x.data(), points.y.data(), points.z.data(), skyOutputs, n, sceneSdf.time);
+
+  std::vector<glm::vec3> colors(n);
+  std::vector<glm::vec3> lightGlow(n, glm::vec3(0.0f));
+  std::vector<size_t> hits;
+  for (size_t i = 0; i < n; i++) {
+    const Ray& r = rays[i];
+    bool hit = !(r.dist > tmax || r.candidateError > pixelRadius);
+    for (size_t l = 0; l < lightCount; l++) {
+      glm::vec3 lpos = lightVec3(l, 0, i);
+      glm::vec3 lcolor = lightVec3(l, 3, i);
+      if (lights[l].directional) {
+        lpos = glm::normalize(lpos);
+        if (r.dist < tmax && r.candidateError <= pixelRadius)
+          continue;
+        float g = std::max(glm::dot(lpos, r.rd), 0.0f);
+        g *= g;
+        lightGlow[i] += lcolor * g / (1.0f + ((1.0f - g) / (0.0005f + 0.02f * lightFloat(l, 6, i))));
+        continue;
+      }
+      glm::vec3 ab = r.ro - lpos;
+      float pd = glm::length(r.ro - r.pos);
+      float d = glm::length(ab);
+      if (pd < d || glm::dot(ab, r.rd) > 0.0f)
+        continue;
+      glm::vec3 ac = (r.ro + r.rd * d) - lpos;
+      glm::vec3 abd = glm::cross(ab, ac);
+      float ar = glm::dot(abd, abd) / d;
+      lightGlow[i] += lcolor / (0.001f + (30.0f * ar * ar * (0.5f + lightFloat(l, 7, i)) / (0.005f + lightFloat(l, 6, i))));
+    }
+
+    glm::vec3 skyColor(sky[i], sky[n + i], sky[2 * n + i]);
+    if (hit)
+      hits.push_back(i);
+    else
+      colors[i] = skyColor + lightGlow[i];
+  }
+
+  // shading of the rays that hit something, again as packets
+  const size_t hitCount = hits.size();
+  std::vector<SurfaceSample> surfaces(hitCount);
+  std::vector<glm::vec3> hitPos(hitCount), normals(hitCount);
+  if (hitCount > 0) {
+    std::vector<float> surfaceValues(5 * hitCount);
+    float* surfaceOutputs[5];
+    for (int c = 0; c < 5; c++)
+      surfaceOutputs[c] = &surfaceValues[c * hitCount];
+    points.resize(hitCount);
+    for (size_t k = 0; k < hitCount; k++) {
+      hitPos[k] = rays[hits[k]].pos;
+      points.set(k, hitPos[k]);
+    }
+    surfaceTape.evaluate(points.x.data(), points.y.data(), points.z.data(), surfaceOutputs, hitCount, sceneSdf.time);
+
+    // sceneSdfSurf, objects join with uSurf
+    for (size_t k = 0; k < hitCount; k++) {
+      SurfaceSample& s = surfaces[k];
+      s = {surfaceOutputs[0][k], glm::vec3(surfaceOutputs[1][k], surfaceOutputs[2][k], surfaceOutputs[3][k]), 0.0f, surfaceOutputs[4][k]};
+      if (const ObjectUboData* obj = sceneSdf.closestObject(hitPos[k], s.dist))
+        s = {s.dist, obj->typeMatIdMode.x > 0 ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(1.0f), static_cast<float>(obj->typeMatIdMode.z), 0.0f};
+    }
+
+    // calcNormal
+    const float o = 0.001f;
+    points.resize(3 * hitCount);
+    for (size_t k = 0; k < hitCount; k++) {
+      points.set(3 * k, hitPos[k] + glm::vec3(o, 0.0f, 0.0f));
+      points.set(3 * k + 1, hitPos[k] + glm::vec3(0.0f, o, 0.0f));
+      points.set(3 * k + 2, hitPos[k] + glm::vec3(0.0f, 0.0f, o));
+    }
+    sceneDistances(points, distances);
+    for (size_t k = 0; k < hitCount; k++) {
+      float d0 = surfaces[k].dist;
+      normals[k] = glm::normalize(glm::vec3(d0 - distances[3 * k], d0 - distances[3 * k + 1], d0 - distances[3 * k + 2]));
+    }
+  }
+
+  std::vector<glm::vec3> lighting(hitCount, glm::vec3(0.0f));
+  std::vector<glm::vec3> shadowDirs(hitCount);
+  std::vector<float> shadowMaxt(hitCount), shadowW(hitCount), shadows;
+  for (size_t l = 0; l < lightCount; l++) {
+    std::vector<glm::vec3> lightDirs(hitCount);
+    for (size_t k = 0; k < hitCount; k++) {
+      size_t i = hits[k];
+      glm::vec3 lpos = lightVec3(l, 0, i);
+      lightDirs[k] = lights[l].directional ? -glm::normalize(lpos) : glm::normalize(hitPos[k] - lpos);
+      shadowDirs[k] = -lightDirs[k];
+      shadowMaxt[k] = lights[l].directional ? 100.0f : glm::length(hitPos[k] - lpos);
+      shadowW[k] = lightFloat(l, 6, i);
+    }
+    softShadows(hitPos, shadowDirs, lights[l].shadowSteps, 0.2f, shadowMaxt, shadowW, shadows);
+
+    for (size_t k = 0; k < hitCount; k++) {
+      size_t i = hits[k];
+      const SurfaceSample& s = surfaces[k];
+      glm::vec3 reflectDir = glm::reflect(-lightDirs[k], normals[k]);
+      float diffuse = std::max(glm::dot(lightDirs[k], normals[k]), 0.0f);
+      float r0 = s.roughness;
+      float r1 = 1.0f - r0;
+      float specular = 2.0f * std::pow(std::max(glm::dot(rays[i].rd, reflectDir), 0.0f), 1.0f / (r0 * r0)) * (r1 * r1);
+
+      float shadow = shadows[k];
+      if (!lights[l].directional) {
+        float dr = shadowMaxt[k];
+        shadow /= (1.0f + (dr * dr) * lightFloat(l, 7, i));
+      }
+      lighting[k] += (diffuse * s.color + specular) * lightVec3(l, 3, i) * shadow;
+    }
+  }
+
+  if (hitCount > 0) {
+    // ambient occlusion
+    float oct = settings.occlusionParams.y;
+    points.resize(hitCount);
+    for (size_t k = 0; k < hitCount; k++)
+      points.set(k, hitPos[k] - normals[k] * oct);
+    sceneDistances(points, distances);
+    for (size_t k = 0; k < hitCount; k++) {
+      float occl = distances[k] - oct;
+      occl = 1.0f - std::min(occl * occl, 1.0f);
+      glm::vec3 ambient = settings.ambientColor * glm::mix(1.0f, occl, settings.occlusionParams.x);
+      lighting[k] += surfaces[k].color * ambient;
+    }
+  }
+
+  // reflections of the sky
+  std::vector<size_t> reflective;
+  std::vector<glm::vec3> reflPos, reflDirs;
+  std::vector<float> reflMaxt, reflW;
+  for (size_t k = 0; k < hitCount; k++) {
+    if (surfaces[k].roughness >= 0.99f)
+      continue;
+    float r0 = 1.0f - surfaces[k].roughness;
+    reflective.push_back(k);
+    reflPos.push_back(hitPos[k]);
+    reflDirs.push_back(glm::reflect(rays[hits[k]].rd, normals[k]));
+    reflMaxt.push_back(30.0f);
+    reflW.push_back((1.0f - r0 * r0) * 0.7f);
+  }
+  std::vector<float> reflSky(3 * reflective.size());
+  if (!reflective.empty()) {
+    size_t m = reflective.size();
+    float* reflOutputs[3] = {&reflSky[0], &reflSky[m], &reflSky[2 * m]};
+    points.resize(m);
+    for (size_t j = 0; j < m; j++)
+      points.set(j, reflDirs[j]);
+    skyTape.evaluate(points.x.data(), points.y.data(), points.z.data(), reflOutputs, m, sceneSdf.time);
+    softShadows(reflPos, reflDirs, settings.reflRaymarchSteps, 0.3f, reflMaxt, reflW, shadows);
+  }
+
+  for (size_t k = 0, j = 0; k < hitCount; k++) {
+    size_t i = hits[k];
+    const Ray& r = rays[i];
+    const SurfaceSample& s = surfaces[k];
+    float cosr = 1.0f - std::max(glm::dot(normals[k], r.rd), 0.0f);
+    glm::vec3 col = lighting[k];
+
+    if (j < reflective.size() && reflective[j] == k) {
+      size_t m = reflective.size();
+      glm::vec3 co(reflSky[j], reflSky[m + j], reflSky[2 * m + j]);
+      float r0 = 1.0f - s.roughness;
+      float fresnel = 0.06f + 0.94f * cosr * cosr * cosr;
+      col += shadows[j] * fresnel * co * r0;
+      j++;
+    }
+
+    float selfactor = 0.1f + 0.2f * cosr + 0.7f * cosr * cosr * cosr;
+    selfactor *= s.selected;
+    col = glm::mix(col, glm::vec3(1.0f, 0.7f, 0.3f), selfactor);
+    col *= 1.0f + selfactor;
+    glm::vec3 skyColor(sky[i], sky[n + i], sky[2 * n + i]);
+    col = glm::mix(col, skyColor, glm::smoothstep(settings.fogFadeIn, 1.0f, r.dist / tmax));
+
+    colors[i] = col + lightGlow[i];
+  }
+
+  // tone mapping of render() and the 8 bit framebuffer
+  const float ws = 0.063f;
+  for (size_t i = 0; i < n; i++) {
+    glm::vec3 c = colors[i];
+    c = c * (1.0f + c * ws) / (1.0f + c);
+    size_t x = x0 + i % tileWidth;
+    size_t y = y0 + i / tileWidth;
+    unsigned char* pixel = &image[(y * width + x) * 3];
+    pixel[0] = toByte(c.r);
+    pixel[1] = toByte(c.g);
+    pixel[2] = toByte(c.b);
+  }
+}
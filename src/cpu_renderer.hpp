@@ -0,0 +1,60 @@
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_sdf.hpp"
+#include "sdf_tape.hpp"
+#include "viewport.hpp"
+
+// Renders the viewport's view without a GPU by reproducing rayMarch of main.fsh in C++. Distances
+// come from SceneSdf, materials, sky and lights from their own SdfTapes. The image is cut
+// into tiles which worker threads take from a shared counter. The rays of a tile are marched as
+// one packet, so each tape call covers a full batch of points. TAA, debug views and evaluation
+// counting are left out.
+class CpuRenderer {
+public:
+  static constexpr int tileSize = 8; // a tile fills one SdfTape batch
+
+  int threads = 0; // 0: one per hardware thread
+
+  int width = 0, height = 0;
+  std::vector<unsigned char> image; // RGB, bottom row first like glReadPixels
+  double renderMs = 0.0;
+  int renderThreads = 0;
+
+  // false if the node graph can't run on the CPU (code nodes)
+  bool render(const Viewport& viewport, int w, int h, float time);
+
+  // same file handling as Viewport::captureImage
+  void saveImage(std::string& filePath) const;
+
+private:
+  struct Points;
+
+  // the uniforms of main.fsh
+  struct Settings {
+    int raymarchSteps, reflRaymarchSteps;
+    float fogFadeIn;
+    glm::vec2 occlusionParams;
+    glm::vec3 ambientColor, proj, camTarget, raymarchParams;
+    glm::mat3 viewRot;
+  } settings = {};
+
+  SceneSdf sceneSdf;
+  SdfTape surfaceTape, skyTape, lightsTape;
+  std::vector<TapeLight> lights;
+
+  void renderTile(int tileX, int tileY);
+
+  void sceneDistances(const Points& points, std::vector<float>& distances) const;
+
+  // softShadow for a packet of rays, maxt and w per ray
+  void softShadows(const std::vector<glm::vec3>& ro, const std::vector<glm::vec3>& rd, int steps, float mint, const std::vector<float>& maxt,
+                   const std::vector<float>& w, std::vector<float>& res) const;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "gpu_timer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+GpuTimer::GpuTimer(std::vector<std::string> passNames) : passNames(std::move(passNames)) {
+  int passes = static_cast<int>(this->passNames.size());
+  queries.resize(ringFrames * passes);
+  glGenQueries(static_cast<int>(queries.size()), queries.data());
+
+  slots.resize(ringFrames);
+  for (auto& slot : slots)
+    slot.issued.resize(passes, 0);
+}
+
+GpuTimer::~GpuTimer() { glDeleteQueries(static_cast<int>(queries.size()), queries.data()); }
+
+bool GpuTimer::collect(int slot) {
+  Slot& s = slots[slot];
+  int passes = static_cast<int>(passNames.size());
+
+  // the last query of a frame finishes last
+  for (int pass = passes - 1; pass >= 0; pass--) {
+    if (s.issued[pass] == 0)
+      continue;
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot * passes + pass], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == 0)
+      return false;
+    break;
+  }
+
+  Frame frame{s.frame, slot, std::vector<float>(passes, -1.0f)};
+  for (int pass = 0; pass < passes; pass++) {
+    if (s.issued[pass] == 0)
+      continue;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[slot * passes + pass], GL_QUERY_RESULT, &elapsed);
+    frame.ms[pass] = static_cast<float>(elapsed) * 1e-6f;
+  }
+  s.pending = false;
+
+  completed.push_back(frame);
+  history.push_back(std::move(frame));
+  if (history.size() > window)
+    history.pop_front();
+  return true;
+}
+
+int GpuTimer::beginFrame() {
+  completed.clear();
+
+  // oldest first so the history stays in frame order
+  while (slots[oldestSlot].pending && collect(oldestSlot))
+    oldestSlot = (oldestSlot + 1) % ringFrames;
+
+  current = frameCounter % ringFrames;
+  Slot& slot = slots[current];
+  if (slot.pending) {
+    dropped++;
+    oldestSlot = (current + 1) % ringFrames;
+  }
+  slot.frame = frameCounter++;
+  slot.pending = true;
+  std::fill(slot.issued.begin(), slot.issued.end(), 0);
+  return current;
+}
+
+void GpuTimer::begin(int pass) {
+  slots[current].issued[pass] = 1;
+  glBeginQuery(GL_TIME_ELAPSED, queries[current * static_cast<int>(passNames.size()) + pass]);
+}
+
+void GpuTimer::end() { glEndQuery(GL_TIME_ELAPSED); }
+
+const std::vector<GpuTimer::Frame>& GpuTimer::getCompleted() const { return completed; }
+
+const std::deque<GpuTimer::Frame>& GpuTimer::getHistory() const { return history; }
+
+GpuTimer::Stats GpuTimer::getStats(int pass) const {
+  std::vector<float> samples;
+  samples.reserve(history.size());
+  for (const auto& frame : history) {
+    if (frame.ms[pass] >= 0.0f)
+      samples.push_back(frame.ms[pass]);
+  }
+  if (samples.empty())
+    return {0.0f, 0.0f, 0.0f, 0};
+
+  std::sort(samples.begin(), samples.end());
+  float sum = 0.0f;
+  for (float ms : samples)
+    sum += ms;
+  auto p99 = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(samples.size()))) - 1;
+  return {samples.front(), sum / static_cast<float>(samples.size()), samples[p99], static_cast<int>(samples.size())};
+}
+
+unsigned long GpuTimer::getDropped() const { return dropped; }
+
+bool GpuTimer::exportCsv(const std::string& filePath) const {
+  std::ofstream file(filePath);
+  if (!file) {
+    std::cerr << "[GPU timer] Failed to open " << filePath << "\n";
+    return false;
+  }
+
+  file << "frame";
+  for (const auto& name : passNames)
+    file << "," << name << "_ms";
+  file << "\n";
+
+  // skipped passes are left empty
+  for (const auto& frame : history) {
+    file << frame.frame;
+    for (float ms : frame.ms) {
+      file << ",";
+      if (ms >= 0.0f)
+        file << ms;
+    }
+    file << "\n";
+  }
+
+  std::cout << "[GPU timer] Exported " << history.size() << " frames to " << filePath << std::endl;
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// GL_TIME_ELAPSED queries around named passes, one set per frame in a ring.
+// Finished frames are collected at the start of later frames without ever
+// waiting on the GPU, a frame whose queries are still busy when its slot comes
+// around again is dropped.
+class GpuTimer {
+public:
+  static constexpr int ringFrames = 4;
+  static constexpr unsigned long window = 600; // frames kept for statistics and export
+
+  struct Frame {
+    int frame;
+    int slot;
+    std::vector<float> ms; // per pass, negative if the pass didn't run that frame
+  };
+
+  struct Stats {
+    float min, avg, p99;
+    int samples;
+  };
+
+  std::vector<std::string> passNames;
+
+  GpuTimer(std::vector<std::string> passNames);
+  ~GpuTimer();
+
+  // collects finished frames and starts recording the next one, returns its ring slot
+  int beginFrame();
+
+  // passes may not overlap
+  void begin(int pass);
+  void end();
+
+  const std::vector<Frame>& getCompleted() const; // frames collected by the last beginFrame
+  const std::deque<Frame>& getHistory() const;
+  Stats getStats(int pass) const;
+  unsigned long getDropped() const;
+
+  bool exportCsv(const std::string& filePath) const;
+
+private:
+  struct Slot {
+    int frame = -1;
+    bool pending = false;
+    std::vector<char> issued;
+  };
+
+  std::vector<GLuint> queries; // ringFrames * passes
+  std::vector<Slot> slots;
+  int frameCounter = 0;
+  int current = -1;     // slot being recorded
+  int oldestSlot = 0;   // next slot to collect
+  unsigned long dropped = 0;
+
+  std::vector<Frame> completed;
+  std::deque<Frame> history;
+
+  bool collect(int slot);
+};
+
+#endif
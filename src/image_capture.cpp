@@ -0,0 +1,182 @@
+#include "image_capture.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include <stb_image_write.h>
+
+ImageCapture::ImageCapture(int encoderThreads) {
+  if (encoderThreads <= 0)
+    encoderThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1);
+  for (int i = 0; i < encoderThreads; i++)
+    encoders.emplace_back(&ImageCapture::encode, this);
+}
+
+ImageCapture::~ImageCapture() {
+  // the GL context may be gone by now, so queued mappings are never read
+  {
+    std::lock_guard lock(mutex);
+    queue.clear();
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& encoder : encoders)
+    encoder.join();
+}
+
+void ImageCapture::flush() {
+  while (!captures.empty())
+    waitOldest();
+
+  glDeleteBuffers(static_cast<GLsizei>(freeBuffers.size()), freeBuffers.data());
+  freeBuffers.clear();
+}
+
+void ImageCapture::request(GLuint framebuffer, int width, int height, const std::string& filePath) {
+  // the ring is full, the oldest capture has to be written before its buffer comes back
+  while (static_cast<int>(captures.size()) >= std::max(ringSize, 1))
+    waitOldest();
+
+  auto capture = std::make_unique<Capture>();
+  capture->filePath = filePath;
+  capture->width = width;
+  capture->height = height;
+  capture->stride = 3 * width;
+  capture->stride += ((capture->stride % 4) != 0) ? (4 - capture->stride % 4) : 0;
+  capture->size = static_cast<GLsizeiptr>(capture->stride) * height;
+  capture->start = std::chrono::steady_clock::now();
+
+  // with a pack buffer bound glReadPixels only queues the copy
+  capture->pbo = takeBuffer(capture->size);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  capture->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  captures.push_back(std::move(capture));
+}
+
+GLuint ImageCapture::takeBuffer(GLsizeiptr size) {
+  // buffers of another size are left from before a resize
+  if (size != freeSize) {
+    glDeleteBuffers(static_cast<GLsizei>(freeBuffers.size()), freeBuffers.data());
+    freeBuffers.clear();
+    freeSize = size;
+  }
+  if (!freeBuffers.empty()) {
+    GLuint pbo = freeBuffers.back();
+    freeBuffers.pop_back();
+    return pbo;
+  }
+
+  GLuint pbo;
+  glGenBuffers(1, &pbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+  glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return pbo;
+}
+
+void ImageCapture::releaseBuffer(Capture& capture) {
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+  if (capture.pixels != nullptr)
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (capture.size == freeSize && static_cast<int>(freeBuffers.size()) < ringSize)
+    freeBuffers.push_back(capture.pbo);
+  else
+    glDeleteBuffers(1, &capture.pbo);
+}
+
+void ImageCapture::map(Capture& capture) {
+  glDeleteSync(capture.fence);
+  capture.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+  capture.pixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture.size, GL_MAP_READ_BIT));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  // a failed mapping still goes through the encoder, which reports it
+  {
+    std::lock_guard lock(mutex);
+    queue.push_back(&capture);
+  }
+  wake.notify_one();
+}
+
+void ImageCapture::waitOldest() {
+  Capture& capture = *captures.front();
+  if (capture.fence != nullptr) {
+    glClientWaitSync(capture.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    map(capture);
+  }
+  {
+    std::unique_lock lock(mutex);
+    encoded.wait(lock, [&] { return capture.encoded.load(std::memory_order_acquire); });
+  }
+  update();
+}
+
+void ImageCapture::update() {
+  std::erase_if(captures, [&](std::unique_ptr<Capture>& capture) {
+    if (capture->fence != nullptr) {
+      GLenum status = glClientWaitSync(capture->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        map(*capture);
+      return false;
+    }
+    if (!capture->encoded.load(std::memory_order_acquire))
+      return false;
+
+    releaseBuffer(*capture);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - capture->start).count();
+    if (capture->saved)
+      std::cout << "[Capture] Saved " << capture->filePath << " in " << ms << " ms\n";
+    else
+      std::cerr << "[Capture] Failed to save " << capture->filePath << "\n";
+    results.push_back({capture->filePath, capture->saved, ms});
+    return true;
+  });
+}
+
+bool ImageCapture::isBusy() const { return !captures.empty(); }
+
+int ImageCapture::getPending() const { return static_cast<int>(captures.size()); }
+
+int ImageCapture::getBacklog() const {
+  return static_cast<int>(std::count_if(captures.begin(), captures.end(), [](const std::unique_ptr<Capture>& capture) { return capture->fence == nullptr && !capture->encoded.load(std::memory_order_acquire); }));
+}
+
+std::vector<ImageCapture::Result> ImageCapture::takeResults() { return std::exchange(results, {}); }
+
+void ImageCapture::encode() {
+  for (;;) {
+    Capture* capture;
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      capture = queue.front();
+      queue.pop_front();
+    }
+
+    // rows come bottom first, a negative stride flips them without stbi_flip_vertically_on_write,
+    // which is a global the other encoders and the UI thread may touch at the same time
+    if (capture->pixels != nullptr) {
+      const unsigned char* top = capture->pixels + static_cast<size_t>(capture->stride) * (capture->height - 1);
+      capture->saved = stbi_write_png(capture->filePath.c_str(), capture->width, capture->height, 3, top, -capture->stride) != 0;
+    }
+    {
+      std::lock_guard lock(mutex);
+      capture->encoded.store(true, std::memory_order_release);
+    }
+    encoded.notify_all();
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef IMAGE_CAPTURE_H
+#define IMAGE_CAPTURE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Saves framebuffer captures without stalling the render loop. glReadPixels goes into a pixel
+// buffer object followed by a fence. Once the fence has passed the buffer is mapped and its
+// pointer handed to the encoder threads, which write the PNG straight from the mapping. The buffer
+// is unmapped again on the GL thread after the encoder is done with it and reused by later requests.
+class ImageCapture {
+public:
+  struct Result {
+    std::string filePath;
+    bool saved;
+    double ms; // from the request to the written file
+  };
+
+  // captures read back or encoding at once, request() waits for the oldest beyond this
+  int ringSize = 8;
+
+  explicit ImageCapture(int encoderThreads = 1); // 0: one per hardware thread but the GL one
+  ~ImageCapture(); // only stops the encoders, captures not flushed are dropped
+
+  // reads the RGB color of framebuffer, filePath gets written as is
+  void request(GLuint framebuffer, int width, int height, const std::string& filePath);
+
+  // moves finished reads on to the encoders and collects encoded images, never waits
+  void update();
+
+  // waits until every capture is written and frees the buffers, needs the GL context
+  void flush();
+
+  bool isBusy() const;
+  int getPending() const; // requested but not written yet
+  int getBacklog() const; // read back and waiting for or in an encoder
+
+  std::vector<Result> takeResults(); // finished since the last call
+
+private:
+  struct Capture {
+    std::string filePath;
+    int width, height, stride;
+    GLuint pbo;
+    GLsizeiptr size;
+    GLsync fence;
+    const unsigned char* pixels = nullptr; // mapped pbo, read by the encoder
+    bool saved = false;
+    std::atomic<bool> encoded{false};
+    std::chrono::steady_clock::time_point start;
+  };
+
+  std::vector<std::unique_ptr<Capture>> captures;
+  std::vector<Result> results;
+
+  // unmapped buffers of freeSize bytes, the ring the captures take theirs from
+  std::vector<GLuint> freeBuffers;
+  GLsizeiptr freeSize = 0;
+
+  std::vector<std::thread> encoders;
+  std::mutex mutex;
+  std::condition_variable wake;    // a capture was queued or the encoders stop
+  std::condition_variable encoded; // a capture was written
+  std::deque<Capture*> queue;
+  bool stopping = false;
+
+  GLuint takeBuffer(GLsizeiptr size);
+  void releaseBuffer(Capture& capture);
+  void map(Capture& capture);
+  void waitOldest();
+  void encode();
+};
+
+#endif
@@ -14,7 +14,7 @@
 
 GLFWwindow* initializeWindow() {
   glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -51,8 +51,8 @@ int main() {
 
   ProjectData pd;
   Scene scene;
-  Viewport viewport(window, &scene);
   NodeEditor nodeEditor;
+  Viewport viewport(window, &scene, &nodeEditor);
 
   initializeImGui(window);
 
@@ -61,6 +61,9 @@ int main() {
   ImGui_ImplGlfw_InitForOpenGL(window, true);
   ImGui_ImplOpenGL3_Init("#version 430");
 
+  // ImGui needs a few frames to settle after an event before the loop may block
+  int idleFrames = 0;
+
   while (glfwWindowShouldClose(window) == 0) {
     buildUi(window, pd, viewport, scene, nodeEditor);
 
@@ -69,9 +72,22 @@ int main() {
 
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     glfwSwapBuffers(window);
-    glfwPollEvents();
+
+    idleFrames = viewport.isIdle() ? idleFrames + 1 : 0;
+    if (idleFrames > 2) {
+      glfwWaitEvents();
+      idleFrames = 0;
+    } else {
+      glfwPollEvents();
+    }
   }
 
+  // captures and background compiles still in flight need the contexts, Viewport, the UI statics
+  // and the compile worker outlive glfwTerminate
+  viewport.imageCapture.flush();
+  shutdownUi(viewport);
+  Shader::shutdownCompiler();
+
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
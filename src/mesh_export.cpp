@@ -0,0 +1,292 @@
+#include "mesh_export.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// x, y and z of a grid point or cell in 21 bits each
+constexpr int keyBits = 21;
+constexpr uint64_t keyMask = (uint64_t(1) << keyBits) - 1;
+
+uint64_t packKey(int x, int y, int z) { return uint64_t(x) | uint64_t(y) << keyBits | uint64_t(z) << (2 * keyBits); }
+
+glm::ivec3 unpackKey(uint64_t key) { return {static_cast<int>(key & keyMask), static_cast<int>(key >> keyBits & keyMask), static_cast<int>(key >> (2 * keyBits))}; }
+
+// corner c of a cell sits at offset (c & 1, c >> 1 & 1, c >> 2 & 1)
+glm::ivec3 cornerOffset(int c) { return {c & 1, c >> 1 & 1, c >> 2 & 1}; }
+
+constexpr size_t evalChunk = 4096; // a multiple of the SdfTape batch
+constexpr size_t cellChunk = 1024;
+
+double msSince(std::chrono::steady_clock::time_point start) { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+
+} // namespace
+
+template <typename Fn>
+void MeshExporter::parallelFor(size_t count, size_t chunk, Fn fn) const {
+  size_t chunkCount = (count + chunk - 1) / chunk;
+  std::atomic<size_t> nextChunk{0};
+  auto worker = [&] {
+    for (size_t c = nextChunk++; c < chunkCount; c = nextChunk++)
+      fn(c * chunk, std::min(count, (c + 1) * chunk));
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(static_cast<size_t>(threadCount), chunkCount); i++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& t : workers)
+    t.join();
+}
+
+void MeshExporter::evaluateGrid(const std::vector<uint64_t>& keys, float offset, float step, std::vector<float>& distances) const {
+  distances.resize(keys.size());
+  glm::vec3 origin = center - 0.5f * size;
+  parallelFor(keys.size(), evalChunk, [&](size_t begin, size_t end) {
+    std::vector<float> x(end - begin), y(end - begin), z(end - begin);
+    for (size_t i = begin; i < end; i++) {
+      glm::vec3 p = origin + (glm::vec3(unpackKey(keys[i])) + offset) * step;
+      x[i - begin] = p.x;
+      y[i - begin] = p.y;
+      z[i - begin] = p.z;
+    }
+    sceneSdf.evaluate(x.data(), y.data(), z.data(), distances.data() + begin, end - begin);
+  });
+}
+
+bool MeshExporter::build(const NodeEditor& nodeEditor, const Scene& scene, float time) {
+  auto start = std::chrono::steady_clock::now();
+
+  sceneSdf.time = time;
+  if (!sceneSdf.load(nodeEditor, scene)) {
+    std::cerr << "[Mesh export] The node graph can't be evaluated on the CPU\n";
+    return false;
+  }
+
+  threadCount = threads > 0 ? threads : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  depth = std::clamp(depth, 1, maxDepth);
+  levels.clear();
+  vertices.clear();
+  indices.clear();
+
+  // full grid at the first level
+  int level = std::min(3, depth);
+  std::vector<uint64_t> cells;
+  for (int z = 0; z < (1 << level); z++) {
+    for (int y = 0; y < (1 << level); y++) {
+      for (int x = 0; x < (1 << level); x++)
+        cells.push_back(packKey(x, y, z));
+    }
+  }
+
+  std::vector<float> distances;
+  std::vector<uint64_t> children;
+  for (;; level++) {
+    auto levelStart = std::chrono::steady_clock::now();
+    float step = size / static_cast<float>(1 << level);
+
+    // with an exact distance the surface only passes through cells whose center is within half a
+    // diagonal of it
+    evaluateGrid(cells, 0.5f, step, distances);
+    float radius = band * 0.5f * std::sqrt(3.0f) * step;
+    size_t tested = cells.size();
+    size_t kept = 0;
+    for (size_t i = 0; i < tested; i++) {
+      if (std::abs(distances[i]) <= radius)
+        cells[kept++] = cells[i];
+    }
+    cells.resize(kept);
+
+    if (level < depth) {
+      children.resize(kept * 8);
+      parallelFor(kept, cellChunk, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          glm::ivec3 cell = unpackKey(cells[i]) * 2;
+          for (int c = 0; c < 8; c++) {
+            glm::ivec3 child = cell + cornerOffset(c);
+            children[i * 8 + c] = packKey(child.x, child.y, child.z);
+          }
+        }
+      });
+    }
+
+    levels.push_back({level, tested, kept, msSince(levelStart)});
+    std::cout << "[Mesh export] Level " << level << " (" << (1 << level) << "^3): kept " << kept << " of " << tested << " cells in "
+              << levels.back().ms << " ms\n";
+    if (level == depth)
+      break;
+    cells.swap(children);
+  }
+
+  auto contourStart = std::chrono::steady_clock::now();
+  std::sort(cells.begin(), cells.end());
+  contour(cells, size / static_cast<float>(1 << depth));
+  contourMs = msSince(contourStart);
+
+  std::cout << "[Mesh export] Contoured " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles in " << contourMs << " ms\n";
+  std::cout << "[Mesh export] Built the mesh on " << threadCount << " threads in " << msSince(start) << " ms\n";
+  return true;
+}
+
+void MeshExporter::contour(const std::vector<uint64_t>& cells, float step) {
+  // corners shared by the band cells are evaluated once
+  std::vector<uint64_t> corners(cells.size() * 8);
+  parallelFor(cells.size(), cellChunk, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      glm::ivec3 cell = unpackKey(cells[i]);
+      for (int c = 0; c < 8; c++) {
+        glm::ivec3 corner = cell + cornerOffset(c);
+        corners[i * 8 + c] = packKey(corner.x, corner.y, corner.z);
+      }
+    }
+  });
+  std::sort(corners.begin(), corners.end());
+  corners.erase(std::unique(corners.begin(), corners.end()), corners.end());
+  std::vector<float> cornerDistances;
+  evaluateGrid(corners, 0.0f, step, cornerDistances);
+
+  auto cornerDistance = [&](const glm::ivec3& p) { return cornerDistances[std::lower_bound(corners.begin(), corners.end(), packKey(p.x, p.y, p.z)) - corners.begin()]; };
+
+  // one vertex per cell the surface crosses, at the mean of the crossings on its edges
+  glm::vec3 origin = center - 0.5f * size;
+  std::vector<glm::vec3> cellVertices(cells.size());
+  std::vector<char> crossed(cells.size(), 0);
+  parallelFor(cells.size(), cellChunk, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      glm::ivec3 cell = unpackKey(cells[i]);
+      float d[8];
+      for (int c = 0; c < 8; c++)
+        d[c] = cornerDistance(cell + cornerOffset(c));
+
+      glm::vec3 sum(0.0f);
+      int count = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        for (int c = 0; c < 8; c++) {
+          int c1 = c | (1 << axis);
+          if (c == c1 || (d[c] < 0.0f) == (d[c1] < 0.0f))
+            continue;
+          float t = d[c] / (d[c] - d[c1]);
+          sum += glm::mix(glm::vec3(cornerOffset(c)), glm::vec3(cornerOffset(c1)), t);
+          count++;
+        }
+      }
+      if (count > 0) {
+        cellVertices[i] = origin + (glm::vec3(cell) + sum / static_cast<float>(count)) * step;
+        crossed[i] = 1;
+      }
+    }
+  });
+
+  std::vector<int64_t> vertexIndices(cells.size(), -1);
+  for (size_t i = 0; i < cells.size(); i++) {
+    if (crossed[i]) {
+      vertexIndices[i] = static_cast<int64_t>(vertices.size());
+      vertices.push_back(cellVertices[i]);
+    }
+  }
+  auto cellVertex = [&](const glm::ivec3& p) -> int64_t {
+    if (p.x < 0 || p.y < 0 || p.z < 0)
+      return -1;
+    uint64_t key = packKey(p.x, p.y, p.z);
+    auto it = std::lower_bound(cells.begin(), cells.end(), key);
+    return it != cells.end() && *it == key ? vertexIndices[it - cells.begin()] : -1;
+  };
+
+  // a quad around every crossed edge, joining the vertices of the 4 cells sharing it. Each edge is
+  // taken from the cell that has it at its first corner. Quads missing a culled cell are left out.
+  size_t chunkCount = (cells.size() + cellChunk - 1) / cellChunk;
+  std::vector<std::vector<uint32_t>> chunkIndices(chunkCount);
+  parallelFor(cells.size(), cellChunk, [&](size_t begin, size_t end) {
+    std::vector<uint32_t>& out = chunkIndices[begin / cellChunk];
+    for (size_t i = begin; i < end; i++) {
+      if (vertexIndices[i] < 0)
+        continue;
+      glm::ivec3 cell = unpackKey(cells[i]);
+      float d0 = cornerDistance(cell);
+      for (int axis = 0; axis < 3; axis++) {
+        glm::ivec3 a(0), u(0), v(0);
+        a[axis] = 1;
+        u[(axis + 1) % 3] = 1;
+        v[(axis + 2) % 3] = 1;
+        if ((d0 < 0.0f) == (cornerDistance(cell + a) < 0.0f))
+          continue;
+
+        int64_t q[4] = {vertexIndices[i], cellVertex(cell - u), cellVertex(cell - u - v), cellVertex(cell - v)};
+        if (q[1] < 0 || q[2] < 0 || q[3] < 0)
+          continue;
+        // counter-clockwise around the axis when it points outside
+        if (d0 >= 0.0f)
+          std::swap(q[1], q[3]);
+        for (int k : {0, 1, 2, 0, 2, 3})
+          out.push_back(static_cast<uint32_t>(q[k]));
+      }
+    }
+  });
+
+  for (const auto& chunk : chunkIndices)
+    indices.insert(indices.end(), chunk.begin(), chunk.end());
+}
+
+bool MeshExporter::save(std::string& filePath) const {
+  bool obj = filePath.ends_with(".obj");
+  if (!obj && !filePath.ends_with(".ply"))
+    filePath += ".ply";
+
+  auto start = std::chrono::steady_clock::now();
+  std::ofstream file(filePath, std::ios::binary);
+  if (!file) {
+    std::cerr << "[Mesh export] Failed to open " << filePath << "\n";
+    return false;
+  }
+
+  size_t triangleCount = indices.size() / 3;
+  if (obj) {
+    file << "# 3DRME mesh export\n";
+    for (const glm::vec3& p : vertices)
+      file << "v " << p.x << " " << p.y << " " << p.z << "\n";
+    for (size_t i = 0; i < indices.size(); i += 3)
+      file << "f " << indices[i] + 1 << " " << indices[i + 1] + 1 << " " << indices[i + 2] + 1 << "\n";
+  } else {
+    file << "ply\n";
+    file << (std::endian::native == std::endian::little ? "format binary_little_endian 1.0\n" : "format binary_big_endian 1.0\n");
+    file << "comment 3DRME mesh export\n";
+    file << "element vertex " << vertices.size() << "\n";
+    file << "property float x\nproperty float y\nproperty float z\n";
+    file << "element face " << triangleCount << "\n";
+    file << "property list uchar int vertex_indices\n";
+    file << "end_header\n";
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+    file.write(reinterpret_cast<const char*>(vertices.data()), static_cast<std::streamsize>(vertices.size() * sizeof(glm::vec3)));
+
+    // faces go out in blocks, each is a count byte and three indices
+    constexpr size_t faceSize = 1 + 3 * sizeof(int32_t);
+    constexpr size_t blockFaces = 16384;
+    std::vector<char> block(blockFaces * faceSize);
+    for (size_t first = 0; first < triangleCount; first += blockFaces) {
+      size_t count = std::min(blockFaces, triangleCount - first);
+      char* out = block.data();
+      for (size_t t = first; t < first + count; t++) {
+        *out++ = 3;
+        std::memcpy(out, &indices[t * 3], 3 * sizeof(int32_t));
+        out += 3 * sizeof(int32_t);
+      }
+      file.write(block.data(), static_cast<std::streamsize>(count * faceSize));
+    }
+  }
+
+  if (!file) {
+    std::cerr << "[Mesh export] Failed to write " << filePath << "\n";
+    return false;
+  }
+  std::cout << "[Mesh export] Saved " << vertices.size() << " vertices, " << triangleCount << " triangles to " << filePath << " in " << msSince(start) << " ms\n";
+  return true;
+}
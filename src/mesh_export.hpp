@@ -0,0 +1,61 @@
+#ifndef MESH_EXPORT_H
+#define MESH_EXPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "node_graph.hpp"
+#include "scene.hpp"
+#include "scene_sdf.hpp"
+
+// Meshes the zero level of SceneSdf inside a cube. An octree is refined from a coarse grid, only
+// cells the surface can pass through are kept and split, so memory follows the surface instead of
+// the volume. The finest level is contoured with surface nets (dual contouring with the mean of the
+// edge crossings as cell vertex). Every stage is spread over worker threads.
+class MeshExporter {
+public:
+  static constexpr int maxDepth = 12;
+
+  glm::vec3 center = glm::vec3(0.0f);
+  float size = 10.0f; // edge length of the cube
+  int depth = 8;      // 2^depth cells along an edge at the finest level
+  // band kept around the surface in half cell diagonals. Scaled objects and smooth operators
+  // overestimate the distance, with 1 their surface loses cells.
+  float band = 2.0f;
+  int threads = 0; // 0: one per hardware thread
+
+  struct LevelStats {
+    int level;
+    size_t tested, kept;
+    double ms;
+  };
+  std::vector<LevelStats> levels;
+  double contourMs = 0.0;
+
+  std::vector<glm::vec3> vertices;
+  std::vector<uint32_t> indices; // triangles, counter-clockwise seen from outside
+
+  // false if the node graph can't run on the CPU (code nodes)
+  bool build(const NodeEditor& nodeEditor, const Scene& scene, float time);
+
+  // binary PLY, or OBJ if the path ends in .obj
+  bool save(std::string& filePath) const;
+
+private:
+  SceneSdf sceneSdf;
+  int threadCount = 1;
+
+  // runs fn(begin, end) over [0, count) in fixed chunks
+  template <typename Fn>
+  void parallelFor(size_t count, size_t chunk, Fn fn) const;
+
+  // sceneSdf at points of the level grid, key packs the integer coordinates
+  void evaluateGrid(const std::vector<uint64_t>& keys, float offset, float step, std::vector<float>& distances) const;
+
+  void contour(const std::vector<uint64_t>& cells, float step);
+};
+
+#endif
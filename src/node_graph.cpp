@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -30,11 +32,33 @@ void NodeEditor::show() {
   manageCreation();
   manageDeletion();
 
+  // baked parameters of a newly selected node must become uniforms again
+  if (bakeParameters && ed::HasSelectionChanged()) {
+    editedNodes.clear();
+    structureOnChangeCallback();
+  }
+
   ed::Suspend();
   if (ed::ShowBackgroundContextMenu()) {
     ImGui::SetCursorScreenPos(ImGui::GetMousePos());
     ImGui::OpenPopup("Create new node");
   }
+  if (ed::ShowNodeContextMenu(&contextNodeId))
+    ImGui::OpenPopup("Node menu");
+  if (ImGui::BeginPopup("Node menu")) {
+    Node* node = findNode(contextNodeId);
+    if (node == nullptr || !node->isSurface()) {
+      ImGui::TextDisabled("Only surfaces can be baked");
+    } else if (brickMap.find(*node) == nullptr) {
+      // the distance variant swaps the subgraph for a texture lookup near the surface
+      if (ImGui::MenuItem("Bake to volume") && brickMap.bake(*node))
+        structureOnChangeCallback();
+    } else if (ImGui::MenuItem("Remove volume")) {
+      brickMap.remove(node->getIdLong());
+      structureOnChangeCallback();
+    }
+    ImGui::EndPopup();
+  }
   if (ImGui::BeginPopup("Create new node")) {
     ImGui::Text("Add node");
     for (const auto& [category, list] : nodeListTree) {
@@ -56,13 +80,61 @@ void NodeEditor::show() {
   ed::End();
 }
 
-void NodeEditor::generateGlslCode(std::string& surface, std::string& sky, std::string& lights) const {
-  dataPointers.clear();
-  if (dataPointers.capacity() < 100)
-    dataPointers.reserve(100);
-  surface = nodes[0]->generateGlsl(0);
-  sky = nodes[0]->generateGlsl(1);
-  lights = nodes[0]->generateGlsl(2);
+void NodeEditor::generateGlslCode(GlslCode& code) const {
+  auto start = std::chrono::steady_clock::now();
+
+  glslContext.beginPass();
+  code.defines = countEvals ? "#define COUNT_EVALS\n" : "";
+  glslContext.bake = bakeParameters;
+  glslContext.liveNodes.clear();
+  if (bakeParameters) {
+    // selected nodes are the ones being edited, keep them as uniforms
+    ed::SetCurrentEditor(editor);
+    std::vector<ed::NodeId> selected(ed::GetSelectedObjectCount());
+    selected.resize(ed::GetSelectedNodes(selected.data(), static_cast<int>(selected.size())));
+    for (const auto& id : selected) {
+      if (const Node* node = findNode(id))
+        glslContext.liveNodes.insert(node);
+    }
+    for (unsigned long id : editedNodes) {
+      if (const Node* node = findNode(id))
+        glslContext.liveNodes.insert(node);
+    }
+  }
+  bakedData.clear();
+  for (const auto& node : nodes) {
+    if (glslContext.isBaked(node.get()) && !node->data.empty())
+      bakedData[node->getIdLong()] = node->data;
+  }
+
+  glslContext.volumes.clear();
+  for (const auto& volume : brickMap.getVolumes()) {
+    if (const Node* node = findNode(volume.nodeId))
+      glslContext.volumes[node] = brickMap.lookupGlsl(*node);
+  }
+
+  const auto& outputs = nodes[0]->inputs;
+  std::string temps;
+  code.surface = generateVariant("Surface", 0, outputs[0], temps);
+  code.surface.insert(0, temps);
+  code.distance = generateVariant("Distance", 3, outputs[0], temps, true);
+  code.distance.insert(0, temps);
+  code.sky = generateVariant("Sky", 1, outputs[1], temps);
+  code.sky.insert(0, temps);
+  code.lights = generateVariant("Lights", 2, outputs[2], code.lightsTemps);
+
+  glslContext.endPass();
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "[Node editor] Generated GLSL in " << elapsed.count() << " ms (" << glslContext.cacheMisses << " regenerated, " << glslContext.cacheHits << " cached)\n";
+}
+
+std::string NodeEditor::generateVariant(const char* name, unsigned long variant, const Pin& root, std::string& temps, bool distanceOnly) const {
+  glslContext.reset(root, distanceOnly);
+  std::string code = nodes[0]->generateGlsl(variant);
+  temps = glslContext.temps;
+  std::cout << "[Node editor] " << name << ": " << glslContext.inlinedCount << " expressions inlined -> " << glslContext.emittedCount << " emitted\n";
+  return code;
 }
 
 Node* NodeEditor::findNode(ed::NodeId id) const {
@@ -174,6 +246,7 @@ void NodeEditor::manageDeletion() {
 
           // delete node
           std::cout << "[Node editor] Delete node " << nodes[i]->getIdLong() << ": " << nodes[i]->getName() << "\n";
+          parameters.release(nodes[i]->dataOffset, nodes[i]->getParameterCount());
           nodes.erase(nodes.begin() + i);
           break;
         }
@@ -216,11 +289,14 @@ std::unique_ptr<Node> NodeEditor::createNode(unsigned long id, NodeType type) {
 void NodeEditor::addNode(NodeType type) {
   if (nodeDefinitions.contains(type)) {
     nodes.push_back(std::make_unique<Node>(nextId, nodeDefinitions.at(type)));
+    nodes.back()->dataOffset = parameters.allocate(nodes.back()->getParameterCount());
     nextId = nodes.back()->getLastId() + 1;
   }
 }
 
 void NodeEditor::saveGraph(SerializableGraph& graph) {
+  // node positions live in the editor context, which only show() makes current otherwise
+  ed::SetCurrentEditor(editor);
   for (auto& node : nodes) {
     auto [x, y] = ed::GetNodePosition(node->getId());
     SerializableNode sNode{node->getIdLong(), node->getType(), x, y, node->getData(), node->code};
@@ -233,8 +309,13 @@ void NodeEditor::saveGraph(SerializableGraph& graph) {
 };
 
 void NodeEditor::loadGraph(SerializableGraph& graph) {
+  ed::SetCurrentEditor(editor);
   nodes.clear();
   links.clear();
+  parameters.clear();
+  brickMap.clear();
+  bakedData.clear();
+  editedNodes.clear();
   nextId = 1;
   std::cout << "[Node editor] Reset graph\n";
 
@@ -245,6 +326,7 @@ void NodeEditor::loadGraph(SerializableGraph& graph) {
       continue;
     }
     newNode->setData(serializableNode.data);
+    newNode->dataOffset = parameters.allocate(newNode->getParameterCount());
     newNode->code = serializableNode.code;
     ed::SetNodePosition(newNode->getId(), ImVec2(serializableNode.px, serializableNode.py));
 
@@ -272,7 +354,94 @@ void NodeEditor::loadGraph(SerializableGraph& graph) {
 
 const std::vector<std::unique_ptr<Node>>& NodeEditor::getNodes() const { return nodes; }
 
+bool NodeEditor::updateParameters() {
+  std::unordered_map<const Node*, glm::vec4> bounds;
+  for (auto& node : nodes) {
+    if (node->isSurface())
+      surfaceBound(&node->outputs[0], node->bound, &bounds);
+  }
+
+  parameters.update(nodes);
+  parameters.bind();
+
+  // the shader doesn't read uN[] for baked nodes, an edit regenerates it with the node live
+  if (bakeParameters) {
+    bool edited = false;
+    for (const auto& node : nodes) {
+      auto it = bakedData.find(node->getIdLong());
+      if (it != bakedData.end() && it->second != node->data) {
+        editedNodes.insert(it->first);
+        bakedData.erase(it);
+        edited = true;
+      }
+    }
+    if (edited)
+      structureOnChangeCallback();
+  }
+
+  // a bake is only valid for the subgraph it was sampled from
+  if (brickMap.validate(nodes))
+    structureOnChangeCallback();
+  brickMap.bind();
+  return parameters.getLastUploadSize() > 0;
+}
+
+// t as a whole identifier, as code nodes refer to the time input
+bool codeUsesTime(const std::string& code) {
+  auto isIdentifierChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) != 0 || c == '_' || c == '.'; };
+  for (size_t i = 0; i < code.size(); i++) {
+    if (code[i] == 't' && (i == 0 || !isIdentifierChar(code[i - 1])) && (i + 1 == code.size() || !isIdentifierChar(code[i + 1])))
+      return true;
+  }
+  return false;
+}
+
+bool NodeEditor::usesTime() const {
+  for (const auto& node : nodes) {
+    if (node->getType() == NodeType::InputTime && !node->outputs[0].pins.empty())
+      return true;
+    if (codeUsesTime(node->code))
+      return true;
+  }
+  return false;
+}
+
+const ParameterBuffer& NodeEditor::getParameters() const { return parameters; }
+
+const BrickMap& NodeEditor::getBrickMap() const { return brickMap; }
+
 void NodeEditor::goToNode(ed::NodeId id) {
   ed::SelectNode(id);
   ed::NavigateToSelection();
 }
+
+void inlineGlslCode(const GlslCode& glsl, std::string& code) {
+  auto line = code.find("// !defines_inline");
+  code.insert(line, glsl.defines);
+  line = code.find("// !sky_inline", line);
+  code.insert(line, glsl.sky);
+  line = code.find("// !sdf_inline", line);
+  code.insert(line, glsl.surface);
+  line = code.find("// !dist_inline", line);
+  code.insert(line, glsl.distance);
+  line = code.find("// !lights_temps_inline", line);
+  code.insert(line, glsl.lightsTemps);
+  line = code.find("// !lights_inline", line);
+  code.insert(line, glsl.lights);
+}
+
+void reloadNodeScene(NodeEditor& nodeEditor, Shader& shader) {
+  GlslCode glsl;
+  nodeEditor.generateGlslCode(glsl);
+
+  shader.resetFshSource();
+  inlineGlslCode(glsl, shader.fshEdited);
+
+  std::cout << "[Node editor] Inline shader code: Surface\n" << glsl.surface << "\n";
+  std::cout << "[Node editor] Inline shader code: Distance\n" << glsl.distance << "\n";
+  std::cout << "[Node editor] Inline shader code: Sky\n" << glsl.sky << "\n";
+  std::cout << "[Node editor] Inline shader code: Lights\n" << glsl.lightsTemps << glsl.lights << "\n";
+  std::cout << "[Node editor] uN[] size: " << nodeEditor.getParameters().getSize() << "\n\n";
+
+  shader.reloadFragment();
+}
@@ -2,7 +2,9 @@
 #define NODE_GRAPH_H
 
 #include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cereal/types/vector.hpp>
@@ -10,7 +12,10 @@
 #include <imgui.h>
 #include <imgui_node_editor.h>
 
+#include "brick_map.hpp"
 #include "nodes.hpp"
+#include "parameter_buffer.hpp"
+#include "shader.hpp"
 
 namespace ed = ax::NodeEditor;
 
@@ -34,14 +39,26 @@ struct SerializableGraph {
   template <class Archive> void serialize(Archive& archive) { archive(nodes, links); }
 };
 
+struct GlslCode {
+  std::string defines; // codegen options, ahead of everything else
+  std::string surface;
+  std::string distance; // surface without material, used wherever only the distance is needed
+  std::string sky;
+  std::string lights;
+  std::string lightsTemps; // lights are inlined into an array constructor, so their temporaries go separately
+};
+
 class NodeEditor {
 public:
+  bool bakeParameters = false; // emit parameters as literals, except for the selected nodes
+  bool countEvals = false;     // compile the SDF evaluation counters of the cost heatmap and SdfCounters
+
   NodeEditor();
   ~NodeEditor();
 
   void show();
 
-  void generateGlslCode(std::string& surface, std::string& sky, std::string& lights) const;
+  void generateGlslCode(GlslCode& code) const;
 
   void saveGraph(SerializableGraph& graph);
   void loadGraph(SerializableGraph& graph);
@@ -51,18 +68,33 @@ public:
 
   const std::vector<std::unique_ptr<Node>>& getNodes() const;
 
+  bool updateParameters(); // true if any parameter was uploaded
+  bool usesTime() const;   // the image changes over time
+  const ParameterBuffer& getParameters() const;
+  const BrickMap& getBrickMap() const;
+
   void setStructureOnChangeCallback(const std::function<void()>& callback) { structureOnChangeCallback = callback; }
 
 private:
   std::vector<std::unique_ptr<Node>> nodes;
   std::vector<Link> links;
 
+  ParameterBuffer parameters;
+  BrickMap brickMap; // baked surface nodes, not saved with the project
+
+  ed::NodeId contextNodeId = 0;
+
   ed::EditorContext* editor = nullptr;
 
   unsigned long nextId = 1;
 
   std::function<void()> structureOnChangeCallback = [] {};
 
+  // bake mode: node data as emitted into the literals, and baked nodes edited since, which stay
+  // uniforms until the code is regenerated for another selection
+  mutable std::unordered_map<unsigned long, std::vector<float>> bakedData;
+  std::set<unsigned long> editedNodes;
+
   Node* findNode(ed::NodeId id) const;
   Pin* findPin(ed::PinId id) const;
   bool isInvalidPinLink(const Pin* a, const Pin* b) const;
@@ -71,6 +103,14 @@ private:
   void manageDeletion();
 
   std::unique_ptr<Node> createNode(unsigned long id, NodeType type);
+
+  std::string generateVariant(const char* name, unsigned long variant, const Pin& root, std::string& temps, bool distanceOnly = false) const;
 };
 
+// splices generated code into the main.fsh template at its // !*_inline markers
+void inlineGlslCode(const GlslCode& glsl, std::string& code);
+
+// regenerates the node code and starts recompiling shader with it
+void reloadNodeScene(NodeEditor& nodeEditor, Shader& shader);
+
 #endif
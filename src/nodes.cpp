@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <format>
 #include <iostream>
 #include <string>
@@ -41,7 +43,7 @@ void Pin::clearLinks() {
   pins.clear();
 }
 
-std::string Pin::generateGlsl() const { return node->generateGlsl(id.Get()); }
+std::string Pin::generateGlsl() const { return glslContext.generate(this); }
 
 Node::Node(unsigned long id, const NodeDefinition& definition) : id(id), definition(definition), lastId(id) { //
   std::cout << "[Node editor] Create node " << id << ": " << definition.name << "\n";
@@ -130,6 +132,10 @@ const ed::NodeId& Node::getId() const { return id; };
 unsigned long Node::getIdLong() const { return id.Get(); };
 unsigned long Node::getLastId() const { return lastId; };
 NodeType Node::getType() const { return definition.type; };
+bool Node::hasDataInCode() const { return definition.dataInCode; };
+bool Node::isSurface() const { return outputs.size() == 1 && outputs[0].type == PinType::Surface; };
+unsigned long Node::getParameterCount() const { return data.size() + (isSurface() ? 4 : 0); };
+unsigned long Node::getBoundOffset() const { return dataOffset + data.size(); };
 const std::string& Node::getName() const { return definition.name; };
 const std::vector<Pin>& Node::getInputs() const { return inputs; };
 const std::vector<Pin>& Node::getOutputs() const { return outputs; };
@@ -142,15 +148,171 @@ std::vector<float> Node::getData() const { return data; }
 
 void Node::setData(const std::vector<float>& data) { this->data = data; }
 
-unsigned long appendDataPtrs(const Node* node) {
-  unsigned long index = dataPointers.size();
-  for (const auto& x : node->data)
-    dataPointers.push_back(&x);
-  return index;
+const char* glslTypeName(PinType type) {
+  switch (type) {
+  case PinType::Vec3:
+    return "vec3";
+  case PinType::Float:
+    return "float";
+  case PinType::Surface:
+    return "Surface";
+  default:
+    return "Light";
+  }
+}
+
+void GlslContext::reset(const Pin& root, bool distOnly) {
+  distanceOnly = distOnly;
+  temps.clear();
+  uses.clear();
+  treeSizes.clear();
+  hashes.clear();
+  emitted.clear();
+  inlinedCount = 0;
+  emittedCount = 0;
+  for (const Pin* p : root.pins)
+    inlinedCount += countUses(p);
+}
+
+bool GlslContext::isBaked(const Node* node) const { return bake && !liveNodes.contains(node); }
+
+void GlslContext::beginPass() {
+  cacheHits = 0;
+  cacheMisses = 0;
 }
 
-std::string uNFloat(unsigned long index) { return std::format("uN[{}]", index); }
-std::string uNVec3(unsigned long index) { return std::format("vec3(uN[{}],uN[{}],uN[{}])", index, index + 1, index + 2); }
+void GlslContext::endPass() {
+  // entries not used by this pass belong to subgraphs that changed or were removed
+  cache = std::move(nextCache);
+  nextCache.clear();
+}
+
+unsigned long GlslContext::countUses(const Pin* pin) {
+  unsigned long id = pin->id.Get();
+  if (uses[id]++ > 0)
+    return treeSizes[id];
+
+  unsigned long size = 1;
+  for (const auto& input : pin->node->inputs) {
+    for (const Pin* p : input.pins)
+      size += countUses(p);
+  }
+  treeSizes[id] = size;
+  return size;
+}
+
+void hashCombine(size_t& seed, size_t value) { seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2); }
+
+size_t GlslContext::hashPin(const Pin* pin) {
+  unsigned long id = pin->id.Get();
+  if (auto it = hashes.find(id); it != hashes.end())
+    return it->second;
+
+  const Node* node = pin->node;
+  bool baked = !node->data.empty() && isBaked(node);
+
+  size_t seed = std::hash<int>{}(static_cast<int>(node->getType()));
+  hashCombine(seed, pin - node->outputs.data()); // output index
+  hashCombine(seed, distanceOnly);
+  hashCombine(seed, node->dataOffset);
+  hashCombine(seed, baked);
+  hashCombine(seed, std::hash<std::string>{}(node->code));
+  if (auto it = volumes.find(node); it != volumes.end()) {
+    hashCombine(seed, std::hash<std::string>{}(it->second.temps));
+    hashCombine(seed, std::hash<std::string>{}(it->second.code));
+    hashCombine(seed, id); // the lookup temporaries are named after the pin
+  }
+  if (baked || node->hasDataInCode()) {
+    for (float x : node->data)
+      hashCombine(seed, std::hash<float>{}(x));
+  }
+  for (const auto& input : node->inputs) {
+    hashCombine(seed, input.pins.size());
+    for (const Pin* p : input.pins) {
+      hashCombine(seed, hashPin(p));
+      // shared inputs are referenced by their temporary name
+      if (uses[p->id.Get()] > 1)
+        hashCombine(seed, p->id.Get());
+    }
+  }
+
+  hashes[id] = seed;
+  return seed;
+}
+
+void GlslContext::emitTemps(const Pin* pin) {
+  for (const auto& input : pin->node->inputs) {
+    for (const Pin* p : input.pins) {
+      if (uses[p->id.Get()] > 1) {
+        generate(p);
+      } else {
+        emitVolumeTemps(p);
+        emitTemps(p);
+      }
+    }
+  }
+}
+
+void GlslContext::emitVolumeTemps(const Pin* pin) {
+  auto it = volumes.find(pin->node);
+  if (!distanceOnly || it == volumes.end())
+    return;
+  unsigned long id = pin->id.Get();
+  temps += std::vformat(it->second.temps, std::make_format_args(id));
+}
+
+std::string GlslContext::generate(const Pin* pin) {
+  unsigned long id = pin->id.Get();
+  std::string name = std::format("t{}", id);
+  if (emitted.contains(id))
+    return name;
+
+  CacheKey key{hashPin(pin), id};
+  std::string code;
+  if (auto it = nextCache.find(key); it != nextCache.end()) {
+    code = it->second;
+    cacheHits++;
+    emitTemps(pin);
+  } else if (auto it = cache.find(key); it != cache.end()) {
+    code = it->second;
+    nextCache.emplace(key, code);
+    cacheHits++;
+    emitTemps(pin);
+  } else {
+    code = pin->node->generateGlsl(id);
+    if (auto it = volumes.find(pin->node); distanceOnly && it != volumes.end())
+      code = std::vformat(it->second.code, std::make_format_args(id, code));
+    nextCache.emplace(key, code);
+    cacheMisses++;
+  }
+  emitVolumeTemps(pin);
+  emittedCount++;
+
+  // identifiers (pos, t) are as cheap as a temporary
+  bool isIdentifier = std::all_of(code.begin(), code.end(), [](char c) { return std::isalnum(c) != 0 || c == '_'; });
+  if (uses[id] < 2 || isIdentifier)
+    return code;
+
+  const char* type = distanceOnly && pin->type == PinType::Surface ? "float" : glslTypeName(pin->type);
+  temps += std::format("{} {}={};\n", type, name, code);
+  emitted.insert(id);
+  return name;
+}
+
+// '#' keeps the decimal point so the literal is always a float
+std::string glslFloat(float value) { return value < 0.0f ? std::format("({:#})", value) : std::format("{:#}", value); }
+
+std::string uNFloat(const Node* node, int loc) {
+  if (glslContext.isBaked(node))
+    return glslFloat(node->data[loc]);
+  return std::format("uN[{}]", node->dataOffset + loc);
+}
+std::string uNVec3(const Node* node, int loc) {
+  if (glslContext.isBaked(node))
+    return std::format("vec3({},{},{})", glslFloat(node->data[loc]), glslFloat(node->data[loc + 1]), glslFloat(node->data[loc + 2]));
+  unsigned long index = node->dataOffset + loc;
+  return std::format("vec3(uN[{}],uN[{}],uN[{}])", index, index + 1, index + 2);
+}
 
 void Node::drawBaseOutput(int index) {
   auto& pin = outputs[index];
@@ -187,6 +349,127 @@ void Node::drawBaseInput(int index, std::function<void()> inner) {
     inner();
 }
 
+// smallest sphere containing both
+glm::vec4 mergeBounds(const glm::vec4& a, const glm::vec4& b) {
+  glm::vec3 offset = glm::vec3(b) - glm::vec3(a);
+  float d = glm::length(offset);
+  if (d + b.w <= a.w)
+    return a;
+  if (d + a.w <= b.w)
+    return b;
+  float r = 0.5f * (d + a.w + b.w);
+  return glm::vec4(glm::vec3(a) + offset * ((r - a.w) / d), r);
+}
+
+bool surfaceBound(const Pin* pin, glm::vec4& bound, std::unordered_map<const Node*, glm::vec4>* memo) {
+  const Node* node = pin->node;
+  if (memo != nullptr) {
+    if (auto it = memo->find(node); it != memo->end()) {
+      bound = it->second;
+      return bound.w >= 0.0f;
+    }
+  }
+
+  const auto& d = node->data;
+  const auto& inputs = node->inputs;
+  bool bounded = true;
+
+  // primitives: color (0) and roughness (1) may be linked, the shape inputs may not
+  auto primitive = [&](float radius) {
+    for (size_t i = 2; i < inputs.size(); i++)
+      bounded = bounded && inputs[i].pins.empty();
+    bound = glm::vec4(d[4], d[5], d[6], radius);
+  };
+
+  switch (node->getType()) {
+  case NodeType::SurfaceCreateSphere:
+    primitive(std::abs(d[7]));
+    break;
+  case NodeType::SurfaceCreateBox:
+    primitive(glm::length(glm::vec3(d[7], d[8], d[9])));
+    break;
+  case NodeType::SurfaceCreateCylinder: // sdfCylinder radius is 2*ra
+    primitive(glm::length(glm::vec2(2.0f * d[7], d[8])) + std::abs(d[9]));
+    break;
+  case NodeType::SurfaceCreateTorus:
+    primitive(std::abs(d[7]) + std::abs(d[8]));
+    break;
+  case NodeType::SurfaceCreateCone:
+    primitive(glm::length(glm::vec2(d[7], std::max(std::abs(d[8]), std::abs(d[9])))) + std::abs(d[10]));
+    break;
+  case NodeType::SurfaceBoolean: {
+    const auto& i0 = inputs[0].pins;
+    const auto& i1 = inputs[1].pins;
+    float typef = d[0];
+    float smooth = std::max(d[1], 0.0f);
+    bounded = !i0.empty() && surfaceBound(i0[0], bound, memo);
+    if (typef == 1.0f) // difference stays inside A
+      break;
+    for (const Pin* p : i1) {
+      glm::vec4 b;
+      bool pBounded = surfaceBound(p, b, memo);
+      if (typef == 2.0f) { // intersection fits inside the smaller input
+        if (pBounded && (!bounded || b.w < bound.w))
+          bound = b;
+        bounded = bounded || pBounded;
+      } else {
+        bounded = bounded && pBounded;
+        if (bounded)
+          bound = mergeBounds(bound, b);
+      }
+    }
+    // smin goes at most k below min
+    if (typef == 0.0f)
+      bound.w += smooth;
+    break;
+  }
+  case NodeType::SurfaceMix: {
+    // mix(a,b,k) never goes below min(a,b), an empty input is infinitely far away
+    const auto& a = inputs[0].pins;
+    const auto& b = inputs[1].pins;
+    glm::vec4 ba, bb;
+    bool aBounded = !a.empty() && surfaceBound(a[0], ba, memo);
+    bool bBounded = !b.empty() && surfaceBound(b[0], bb, memo);
+    bounded = (aBounded || a.empty()) && (bBounded || b.empty()) && (aBounded || bBounded);
+    if (bounded)
+      bound = !aBounded ? bb : (!bBounded ? ba : mergeBounds(ba, bb));
+    break;
+  }
+  default:
+    bounded = false;
+  }
+
+  if (memo != nullptr)
+    memo->emplace(node, bounded ? bound : glm::vec4(-1.0f));
+  return bounded;
+}
+
+// Distance code of a surface input, short-circuited to the distance of its bounding sphere while
+// the sample point is further than margin away from it. Only the distance variant is culled, the
+// surface variant blends materials of inputs that may be far away.
+std::string culledSurfaceGlsl(const Pin* pin, const std::string& margin) {
+  std::string code = pin->generateGlsl();
+  glm::vec4 bound;
+  // a sphere is as cheap as its bound, shared inputs are computed up front anyway
+  bool isIdentifier = std::all_of(code.begin(), code.end(), [](char c) { return std::isalnum(c) != 0 || c == '_'; });
+  if (!glslContext.distanceOnly || pin->node->getType() == NodeType::SurfaceCreateSphere || isIdentifier || !surfaceBound(pin, bound))
+    return code;
+  unsigned long offset = pin->node->getBoundOffset();
+  return std::format("(boundDist(pos,{})>{}?boundDist(pos,{}):{})", offset, margin, offset, code);
+}
+
+std::string emptySurfaceGlsl() { return glslContext.distanceOnly ? "FLOAT_MAX" : "Surface(FLOAT_MAX,vec3(0),0.0,0.0)"; }
+
+// Wraps a distance expression with the color and roughness pins (0 and 1) of a surface node.
+// The distance only variant skips the material inputs entirely.
+std::string surfaceGlsl(const Node* node, const std::string& sdfCode, int colLoc, int roughnessLoc) {
+  if (glslContext.distanceOnly)
+    return sdfCode;
+  std::string colCode = node->pin0GenerateGlsl(0, uNVec3(node, colLoc));
+  std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(node, roughnessLoc));
+  return std::format("Surface({},{},0.0,{})", sdfCode, colCode, roughnessCode);
+}
+
 std::string toVec3String(float x, float y, float z) { return std::format("vec3({},{},{})", x, y, z); }
 std::string toVec3String(const float* data) { return toVec3String(*(data), *(data + 1), *(data + 2)); }
 
@@ -217,6 +500,13 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(2);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long variant) -> std::string {
+      // distance only surface variant
+      if (variant == 3) {
+        const Pin& i0 = node->inputs[0];
+        if (i0.pins.empty())
+          return "";
+        return std::format("d={};", culledSurfaceGlsl(i0.pins[0], "0.0"));
+      }
       // surface variant
       if (variant == 0) {
         const Pin& i0 = node->inputs[0];
@@ -267,12 +557,10 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(3, [&] { drawFloatEdit("##radius", &node->data[radiusLoc], 0.03, 0, 1e3); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(index + radiusLoc));
-      return std::format("Surface(sdfSphere({},{}),{},0.0,{})", posCode, radiusCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(node, radiusLoc));
+      std::string sdfCode = std::format("sdfSphere({},{})", posCode, radiusCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -305,13 +593,11 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(4, [&] { drawFloatEdit("##round", &node->data[roundingLoc]); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string boundCode = node->pin0GenerateGlsl(3, uNVec3(index + sizeLoc));
-      std::string roundingCode = node->pin0GenerateGlsl(4, uNFloat(index + roundingLoc));
-      return std::format("Surface(sdfBox({},{},{}),{},0.0,{})", posCode, boundCode, roundingCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string boundCode = node->pin0GenerateGlsl(3, uNVec3(node, sizeLoc));
+      std::string roundingCode = node->pin0GenerateGlsl(4, uNFloat(node, roundingLoc));
+      std::string sdfCode = std::format("sdfBox({},{},{})", posCode, boundCode, roundingCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -348,14 +634,12 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(5, [&] { drawFloatEdit("##round", &node->data[roundingLoc], 0.03, 0.0, 1e2); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(index + radiusLoc));
-      std::string heightCode = node->pin0GenerateGlsl(4, uNFloat(index + heightLoc));
-      std::string roundingCode = node->pin0GenerateGlsl(5, uNFloat(index + roundingLoc));
-      return std::format("Surface(sdfCylinder({},{},{},{}),{},0.0,{})", posCode, radiusCode, heightCode, roundingCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(node, radiusLoc));
+      std::string heightCode = node->pin0GenerateGlsl(4, uNFloat(node, heightLoc));
+      std::string roundingCode = node->pin0GenerateGlsl(5, uNFloat(node, roundingLoc));
+      std::string sdfCode = std::format("sdfCylinder({},{},{},{})", posCode, radiusCode, heightCode, roundingCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -388,13 +672,11 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(4, [&] { drawFloatEdit("##thickness", &node->data[thicknessLoc], 0.03, 0.0, 1e2); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(index + radiusLoc));
-      std::string thicknessCode = node->pin0GenerateGlsl(4, uNFloat(index + thicknessLoc));
-      return std::format("Surface(sdfTorus({},{},{}),{},0.0,{})", posCode, radiusCode, thicknessCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string radiusCode = node->pin0GenerateGlsl(3, uNFloat(node, radiusLoc));
+      std::string thicknessCode = node->pin0GenerateGlsl(4, uNFloat(node, thicknessLoc));
+      std::string sdfCode = std::format("sdfTorus({},{},{})", posCode, radiusCode, thicknessCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -435,15 +717,13 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(6, [&] { drawFloatEdit("##rounding", &node->data[roundingLoc], 0.03, 0.0, 1e2); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string heightCode = node->pin0GenerateGlsl(3, uNFloat(index + heightLoc));
-      std::string topRadiusCode = node->pin0GenerateGlsl(4, uNFloat(index + topRadiusLoc));
-      std::string bottomRadiusCode = node->pin0GenerateGlsl(5, uNFloat(index + bottomRadiusLoc));
-      std::string roundingCode = node->pin0GenerateGlsl(6, uNFloat(index + roundingLoc));
-      return std::format("Surface(sdfCappedCone({},{},{},{},{}),{},0.0,{})", posCode, heightCode, topRadiusCode, bottomRadiusCode, roundingCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string heightCode = node->pin0GenerateGlsl(3, uNFloat(node, heightLoc));
+      std::string topRadiusCode = node->pin0GenerateGlsl(4, uNFloat(node, topRadiusLoc));
+      std::string bottomRadiusCode = node->pin0GenerateGlsl(5, uNFloat(node, bottomRadiusLoc));
+      std::string roundingCode = node->pin0GenerateGlsl(6, uNFloat(node, roundingLoc));
+      std::string sdfCode = std::format("sdfCappedCone({},{},{},{},{})", posCode, heightCode, topRadiusCode, bottomRadiusCode, roundingCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -472,12 +752,10 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(3, [&] { drawVec3Edit("##nrm", &node->data[normalLoc], 0.01, -1, 1); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string roughnessCode = node->pin0GenerateGlsl(1, uNFloat(index + roughnessLoc));
-      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(index + posLoc));
-      std::string normalCode = node->pin0GenerateGlsl(3, uNVec3(index + normalLoc));
-      return std::format("Surface(sdfPlane({},{}),{},0.0,{})", posCode, normalCode, colCode, roughnessCode);
+      std::string posCode = node->pin0GenerateGlsl(2, "pos-" + uNVec3(node, posLoc));
+      std::string normalCode = node->pin0GenerateGlsl(3, uNVec3(node, normalLoc));
+      std::string sdfCode = std::format("sdfPlane({},{})", posCode, normalCode);
+      return surfaceGlsl(node, sdfCode, colLoc, roughnessLoc);
     });
     defs.insert({nd.type, nd});
   }
@@ -485,6 +763,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
     const int typeLoc = 0;
     const int smoothLoc = 1;
     NodeDefinition nd{NodeType::SurfaceBoolean, "Surface Boolean", surfaceColor, 100};
+    nd.dataInCode = true;
     nd.initializeData({0, 0});
     nd.addInput("Input A", PinType::Surface);
     nd.addInput("Input B,C..", PinType::Surface, true);
@@ -508,29 +787,42 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(1);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
       const Pin& i0 = node->inputs[0];
       const Pin& i1 = node->inputs[1];
       if (i0.pins.empty())
-        return "Surface(FLOAT_MAX,vec3(0),0.0,0.0)";
-      std::string result = i0.pins[0]->generateGlsl();
+        return emptySurfaceGlsl();
       if (i1.pins.empty())
-        return result;
+        return i0.pins[0]->generateGlsl();
       float typef = node->data[typeLoc];
       float smooth = node->data[smoothLoc];
+      // smooth operators blend inputs closer than 4k
+      std::string margin = smooth > 0.0 ? "4.0*" + uNFloat(node, smoothLoc) : "0.0";
+      std::string result = culledSurfaceGlsl(i0.pins[0], margin);
       std::string func;
       std::string end = ")";
-      if (typef == 0.0f) {
-        func = "uSurf";
-      } else if (typef == 1.0f)
-        func = "dSurf";
-      else if (typef == 2.0f)
-        func = "iSurf";
-      if (smooth > 0.0)
-        end = "," + uNFloat(index + smoothLoc) + ")";
+      if (glslContext.distanceOnly) {
+        // plain distance equivalents of uSurf, dSurf and iSurf
+        if (typef == 0.0f)
+          func = smooth > 0.0 ? "smin" : "min";
+        else if (typef == 1.0f)
+          func = "sdiff";
+        else if (typef == 2.0f)
+          func = smooth > 0.0 ? "smax" : "max";
+        if (smooth > 0.0)
+          end = "," + uNFloat(node, smoothLoc) + ").x";
+      } else {
+        if (typef == 0.0f) {
+          func = "uSurf";
+        } else if (typef == 1.0f)
+          func = "dSurf";
+        else if (typef == 2.0f)
+          func = "iSurf";
+        if (smooth > 0.0)
+          end = "," + uNFloat(node, smoothLoc) + ")";
+      }
       auto l = i1.pins.size();
       for (int i = 0; i < l; i++)
-        result = std::format("{}({},{}{}", func, result, i1.pins[i]->generateGlsl(), end);
+        result = std::format("{}({},{}{}", func, result, culledSurfaceGlsl(i1.pins[i], margin), end);
       return result;
     });
     defs.insert({nd.type, nd});
@@ -549,10 +841,9 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(1);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string surfACode = node->pin0GenerateGlsl(0, "Surface(FLOAT_MAX,vec3(0),0.0,0.0)");
-      std::string surfBCode = node->pin0GenerateGlsl(1, "Surface(FLOAT_MAX,vec3(0),0.0,0.0)");
-      return std::format("mSurf({},{},{})", surfACode, surfBCode, uNFloat(index + mixLoc));
+      std::string surfACode = node->pin0GenerateGlsl(0, emptySurfaceGlsl());
+      std::string surfBCode = node->pin0GenerateGlsl(1, emptySurfaceGlsl());
+      return std::format("{}({},{},{})", glslContext.distanceOnly ? "mix" : "mSurf", surfACode, surfBCode, uNFloat(node, mixLoc));
     });
     defs.insert({nd.type, nd});
   }
@@ -565,8 +856,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       drawFloatEdit("##x", node->data.data());
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      return uNFloat(index);
+      return uNFloat(node, 0);
     });
     defs.insert({nd.type, nd});
   }
@@ -582,6 +872,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
   }
   {
     NodeDefinition nd{NodeType::FloatSine, "Float Sine", floatColor, 70};
+    nd.dataInCode = true;
     nd.initializeData({1});
     nd.addInput("Input", PinType::Float);
     nd.addOutput("Output", PinType::Float);
@@ -602,8 +893,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       drawVec3Edit("##x", node->data.data());
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      return uNVec3(index);
+      return uNVec3(node, 0);
     });
     defs.insert({nd.type, nd});
   }
@@ -619,6 +909,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
   }
   {
     NodeDefinition nd{NodeType::Vec3Math, "Vec3 Math", vec3Color, 80};
+    nd.dataInCode = true;
     nd.initializeData({0});
     nd.addInput("A", PinType::Vec3);
     nd.addInput("B", PinType::Vec3);
@@ -658,9 +949,8 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(0);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
       std::string posCode = node->pin0GenerateGlsl(0, "0.0");
-      return std::format("({}+{})", posCode, uNVec3(index));
+      return std::format("({}+{})", posCode, uNVec3(node, 0));
     });
     defs.insert({nd.type, nd});
   }
@@ -675,9 +965,8 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(0);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
       std::string posCode = node->pin0GenerateGlsl(0, "0.0");
-      return std::format("({}*{})", posCode, uNVec3(index));
+      return std::format("({}*{})", posCode, uNVec3(node, 0));
     });
     defs.insert({nd.type, nd});
   }
@@ -692,9 +981,8 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(0);
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
       std::string posCode = node->pin0GenerateGlsl(0, "0.0");
-      return std::format("({}*rmat({}))", posCode, uNVec3(index));
+      return std::format("({}*rmat({}))", posCode, uNVec3(node, 0));
     });
     defs.insert({nd.type, nd});
   }
@@ -744,6 +1032,7 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
   }
   {
     NodeDefinition nd{NodeType::LightPoint, "Light Point", lightsColor};
+    nd.dataInCode = true;
     const int colLoc = 0;
     const int posLoc = 3;
     const int intensityLoc = 6;
@@ -777,18 +1066,18 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(4, [&] { drawVec3Edit("##pos", &node->data[posLoc]); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colorCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string intensityCode = node->pin0GenerateGlsl(1, uNFloat(index + intensityLoc));
-      std::string radiusCode = node->pin0GenerateGlsl(2, uNFloat(index + radiusLoc));
-      std::string attenuationCode = node->pin0GenerateGlsl(3, uNFloat(index + attenuationLoc));
-      std::string posCode = node->pin0GenerateGlsl(4, uNVec3(index + posLoc));
+      std::string colorCode = node->pin0GenerateGlsl(0, uNVec3(node, colLoc));
+      std::string intensityCode = node->pin0GenerateGlsl(1, uNFloat(node, intensityLoc));
+      std::string radiusCode = node->pin0GenerateGlsl(2, uNFloat(node, radiusLoc));
+      std::string attenuationCode = node->pin0GenerateGlsl(3, uNFloat(node, attenuationLoc));
+      std::string posCode = node->pin0GenerateGlsl(4, uNVec3(node, posLoc));
       return std::format("Light({},{}*{},{},{},{},false)", posCode, intensityCode, colorCode, static_cast<int>(node->data[stepsLoc]), radiusCode, attenuationCode);
     });
     defs.insert({nd.type, nd});
   }
   {
     NodeDefinition nd{NodeType::LightDirectional, "Light Directional", lightsColor};
+    nd.dataInCode = true;
     const int colLoc = 0;
     const int posLoc = 3;
     const int intensityLoc = 6;
@@ -818,11 +1107,10 @@ std::map<NodeType, NodeDefinition> initDefinitions() {
       node->drawBaseInput(3, [&] { drawVec3Edit("##pos", &node->data[posLoc]); });
     });
     nd.setGenerateGlsl([](const Node* node, unsigned long outputPinId) -> std::string {
-      unsigned long index = appendDataPtrs(node);
-      std::string colorCode = node->pin0GenerateGlsl(0, uNVec3(index + colLoc));
-      std::string intensityCode = node->pin0GenerateGlsl(1, uNFloat(index + intensityLoc));
-      std::string radiusCode = node->pin0GenerateGlsl(2, uNFloat(index + radiusLoc));
-      std::string posCode = node->pin0GenerateGlsl(3, uNVec3(index + posLoc));
+      std::string colorCode = node->pin0GenerateGlsl(0, uNVec3(node, colLoc));
+      std::string intensityCode = node->pin0GenerateGlsl(1, uNFloat(node, intensityLoc));
+      std::string radiusCode = node->pin0GenerateGlsl(2, uNFloat(node, radiusLoc));
+      std::string posCode = node->pin0GenerateGlsl(3, uNVec3(node, posLoc));
       return std::format("Light({},{}*{},{},{},0.0,true)", posCode, intensityCode, colorCode, static_cast<int>(node->data[stepsLoc]), radiusCode);
     });
     defs.insert({nd.type, nd});
@@ -897,4 +1185,4 @@ const std::map<std::string, std::map<std::string, NodeType>> nodeListTree = {
     },
 };
 
-std::vector<const float*> dataPointers;
+GlslContext glslContext;
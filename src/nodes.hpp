@@ -3,7 +3,10 @@
 
 #include <functional>
 #include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -80,6 +83,7 @@ struct NodeDefinition {
   std::vector<PinDefinition> inputs;
   std::vector<PinDefinition> outputs;
   std::vector<float> data;
+  bool dataInCode = false; // generateGlsl reads data values directly instead of through uN[]
 
   std::function<void(Node*, const std::vector<float>&)> setData;
   std::function<std::vector<float>(const Node*)> getData;
@@ -98,7 +102,9 @@ public:
   std::vector<Pin> inputs;
   std::vector<Pin> outputs;
   std::vector<float> data;
-  std::string code; // only used by custom code nodes
+  unsigned long dataOffset = 0; // first uN[] slot, stable for the lifetime of the node
+  glm::vec4 bound = glm::vec4(0.0f); // surface nodes: bounding sphere (center, radius), stored in uN[] after data
+  std::string code;             // only used by custom code nodes
 
   Node(unsigned long id, const NodeDefinition& definition);
   ~Node();
@@ -120,6 +126,10 @@ public:
   unsigned long getIdLong() const;
   unsigned long getLastId() const;
   NodeType getType() const;
+  bool hasDataInCode() const;
+  bool isSurface() const;
+  unsigned long getParameterCount() const; // uN[] slots: data, then the bound of surface nodes
+  unsigned long getBoundOffset() const;
   const std::string& getName() const;
   const std::vector<Pin>& getInputs() const;
   const std::vector<Pin>& getOutputs() const;
@@ -138,10 +148,66 @@ struct Link {
   Link(ed::LinkId id, ed::PinId startPinId, ed::PinId endPinId) : id(id), StartPinId(startPinId), EndPinId(endPinId) {}
 };
 
+// Distance code of a baked node in the distance variant, both are format strings where {0} is
+// the output pin id. temps declares the lookup, code uses it with {1} standing for the exact code.
+struct VolumeGlsl {
+  std::string temps;
+  std::string code = "{1}";
+};
+
+// Codegen state for a single output variant (surface, distance, sky or lights).
+// Output pins with more than one consumer are emitted once as SSA temporaries
+// (t<pin id>) instead of being inlined at every use.
+// Generated code is memoized across passes under a structural hash of the pin
+// (node type, upstream structure, uN[] offsets) together with the pin id, so only
+// changed subgraphs are regenerated and a hash collision between pins can't splice
+// in another subgraph's code.
+class GlslContext {
+public:
+  bool distanceOnly = false;      // surfaces generate plain float distances, no material work
+  bool bake = false;              // parameters of nodes not in liveNodes are emitted as literals
+  std::set<const Node*> liveNodes;
+  std::unordered_map<const Node*, VolumeGlsl> volumes; // distance code of baked nodes
+  std::string temps;              // declarations to place before the inlined code
+  unsigned long inlinedCount = 0; // expressions a plain recursive inline would emit
+  unsigned long emittedCount = 0; // expressions actually emitted
+  unsigned long cacheHits = 0;    // per pass
+  unsigned long cacheMisses = 0;
+
+  bool isBaked(const Node* node) const;
+  void beginPass();
+  void endPass();
+  void reset(const Pin& root, bool distOnly = false);
+  std::string generate(const Pin* pin);
+
+private:
+  std::map<unsigned long, int> uses;                 // output pin id -> consumer count
+  std::map<unsigned long, unsigned long> treeSizes; // output pin id -> inlined expression count
+  std::map<unsigned long, size_t> hashes;           // output pin id -> structural hash
+  std::set<unsigned long> emitted;
+
+  using CacheKey = std::pair<size_t, unsigned long>; // structural hash, output pin id
+  struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const { return key.first ^ std::hash<unsigned long>{}(key.second); }
+  };
+  std::unordered_map<CacheKey, std::string, CacheKeyHash> cache;     // code generated by the previous pass
+  std::unordered_map<CacheKey, std::string, CacheKeyHash> nextCache; // code generated or reused by this pass
+
+  unsigned long countUses(const Pin* pin);
+  size_t hashPin(const Pin* pin);
+  void emitTemps(const Pin* pin);
+  void emitVolumeTemps(const Pin* pin);
+};
+
+// Conservative bounding sphere (center, radius) of a surface output, from the parameters of its
+// subtree. Returns false when the subtree is unbounded or shaped by linked inputs. That depends
+// only on the graph structure, so bound values can change without regenerating code.
+bool surfaceBound(const Pin* pin, glm::vec4& bound, std::unordered_map<const Node*, glm::vec4>* memo = nullptr);
+
 extern const std::map<NodeType, NodeDefinition> nodeDefinitions;
 
 extern const std::map<std::string, std::map<std::string, NodeType>> nodeListTree;
 
-extern std::vector<const float*> dataPointers;
+extern GlslContext glslContext;
 
 #endif
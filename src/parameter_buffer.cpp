@@ -0,0 +1,150 @@
+#include "parameter_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+ParameterBuffer::ParameterBuffer() {
+  glGenBuffers(1, &ssbo);
+  reserve(1024);
+
+  // persistent mapping needs GL 4.4, fall back to glBufferSubData otherwise
+  if (GLAD_GL_VERSION_4_4 != 0) {
+    glGenBuffers(1, &staging);
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_READ_BUFFER, ringFrames * ringFrameSize, nullptr, flags);
+    stagingPtr = static_cast<char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, ringFrames * ringFrameSize, flags));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+}
+
+ParameterBuffer::~ParameterBuffer() {
+  for (GLsync fence : fences) {
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  }
+  if (staging != 0) {
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glDeleteBuffers(1, &staging);
+  }
+  glDeleteBuffers(1, &ssbo);
+}
+
+unsigned long ParameterBuffer::allocate(unsigned long count) {
+  auto it = freeRanges.find(count);
+  if (it != freeRanges.end() && !it->second.empty()) {
+    unsigned long offset = it->second.back();
+    it->second.pop_back();
+    return offset;
+  }
+  unsigned long offset = size;
+  size += count;
+  return offset;
+}
+
+void ParameterBuffer::release(unsigned long offset, unsigned long count) {
+  if (count > 0)
+    freeRanges[count].push_back(offset);
+}
+
+void ParameterBuffer::clear() {
+  size = 0;
+  freeRanges.clear();
+}
+
+void ParameterBuffer::reserve(unsigned long count) {
+  if (count <= capacity)
+    return;
+
+  capacity = std::max(count, capacity * 2);
+
+  // NaN never compares equal, so every slot is uploaded once after a resize
+  mirror.resize(capacity, std::numeric_limits<float>::quiet_NaN());
+  std::fill(mirror.begin(), mirror.end(), std::numeric_limits<float>::quiet_NaN());
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(float)), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  std::cout << "[Parameters] Resized buffer to " << capacity << " floats\n";
+}
+
+void ParameterBuffer::update(const std::vector<std::unique_ptr<Node>>& nodes) {
+  reserve(size);
+
+  // offset, count
+  std::vector<std::pair<unsigned long, unsigned long>> ranges;
+  auto diff = [&](unsigned long offset, const float* values, unsigned long count) {
+    float* stored = &mirror[offset];
+    unsigned long first = count;
+    unsigned long last = 0;
+    for (unsigned long i = 0; i < count; i++) {
+      if (values[i] != stored[i]) {
+        first = std::min(first, i);
+        last = i;
+        stored[i] = values[i];
+      }
+    }
+    if (first < count)
+      ranges.emplace_back(offset + first, last - first + 1);
+  };
+
+  for (const auto& node : nodes) {
+    if (!node->data.empty())
+      diff(node->dataOffset, node->data.data(), node->data.size());
+    if (node->isSurface())
+      diff(node->getBoundOffset(), &node->bound[0], 4);
+  }
+
+  lastUploadSize = 0;
+  if (!ranges.empty())
+    upload(ranges);
+}
+
+void ParameterBuffer::upload(const std::vector<std::pair<unsigned long, unsigned long>>& ranges) {
+  glBindBuffer(GL_COPY_WRITE_BUFFER, ssbo);
+
+  GLintptr base = ringFrame * ringFrameSize;
+  GLintptr used = 0;
+  if (stagingPtr != nullptr) {
+    // wait for the copies issued from this segment ringFrames updates ago
+    GLsync& fence = fences[ringFrame];
+    if (fence != nullptr) {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+  }
+
+  for (const auto& [offset, count] : ranges) {
+    auto bytes = static_cast<GLsizeiptr>(count * sizeof(float));
+    auto dst = static_cast<GLintptr>(offset * sizeof(float));
+    if (stagingPtr != nullptr && used + bytes <= ringFrameSize) {
+      std::memcpy(stagingPtr + base + used, &mirror[offset], bytes);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, base + used, dst, bytes);
+      used += bytes;
+    } else {
+      glBufferSubData(GL_COPY_WRITE_BUFFER, dst, bytes, &mirror[offset]);
+    }
+    lastUploadSize += count;
+  }
+
+  if (stagingPtr != nullptr) {
+    fences[ringFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ringFrame = (ringFrame + 1) % ringFrames;
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void ParameterBuffer::bind() const { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo); }
+
+unsigned long ParameterBuffer::getSize() const { return size; }
+
+unsigned long ParameterBuffer::getLastUploadSize() const { return lastUploadSize; }
@@ -0,0 +1,55 @@
+#ifndef PARAMETER_BUFFER_H
+#define PARAMETER_BUFFER_H
+
+#include <array>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "nodes.hpp"
+
+// Node parameters (uN[] in shaders) stored in a shader storage buffer.
+// Every node owns a stable range of the buffer. Each update compares node data
+// against a CPU mirror and only uploads the ranges that changed, staged through
+// a persistently mapped ring buffer when available.
+class ParameterBuffer {
+public:
+  static constexpr GLuint binding = 1;
+
+  ParameterBuffer();
+  ~ParameterBuffer();
+
+  unsigned long allocate(unsigned long count);
+  void release(unsigned long offset, unsigned long count);
+  void clear();
+
+  void update(const std::vector<std::unique_ptr<Node>>& nodes);
+  void bind() const;
+
+  unsigned long getSize() const;
+  unsigned long getLastUploadSize() const; // floats uploaded by the last update
+
+private:
+  static constexpr int ringFrames = 3;
+  static constexpr GLsizeiptr ringFrameSize = 64 * 1024; // bytes
+
+  GLuint ssbo;
+  unsigned long capacity = 0; // floats
+  unsigned long size = 0;     // floats
+  unsigned long lastUploadSize = 0;
+
+  std::map<unsigned long, std::vector<unsigned long>> freeRanges; // count -> offsets
+  std::vector<float> mirror;                                      // current buffer content
+
+  GLuint staging = 0;
+  char* stagingPtr = nullptr;
+  std::array<GLsync, ringFrames> fences = {};
+  int ringFrame = 0;
+
+  void reserve(unsigned long count);
+  void upload(const std::vector<std::pair<unsigned long, unsigned long>>& ranges);
+};
+
+#endif
@@ -66,6 +66,7 @@ void ProjectData::loadProjectFile(Scene& scene, Viewport& viewport, NodeEditor&
 
   cereal::PortableBinaryInputArchive oarchive(file);
   oarchive(scene, viewport, graph);
+  scene.markAllDirty();
 
   sdfnodeeditor.loadGraph(graph);
 
@@ -1,5 +1,7 @@
 #include "scene.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -7,11 +9,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 Scene::Scene() {
-  glGenBuffers(1, &objectUbo);
-  glBindBuffer(GL_UNIFORM_BUFFER, objectUbo);
-  glBufferData(GL_UNIFORM_BUFFER, 32 * sizeof(ObjectUboData), nullptr, GL_DYNAMIC_DRAW); // assuming scene contains at most 32 objects
-  // glBindBufferBase(GL_UNIFORM_BUFFER, 0, objectUbo);                                     // bind location = 0
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  GLint64 maxBlockSize = 0;
+  glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+  maxObjects = static_cast<unsigned long>((maxBlockSize - objectHeaderSize) / static_cast<GLint64>(sizeof(ObjectUboData)));
+
+  glGenBuffers(1, &objectSsbo);
+  reserveObjects(64);
 
   /*
   glGenBuffers(1, &materialUbo);
@@ -23,42 +26,160 @@ Scene::Scene() {
   */
 }
 
-void Scene::addObject(Shape shape) {
+bool Scene::addObject(Shape shape) {
+  if (sceneTree.size() >= maxObjects) {
+    std::cerr << "[Scene] Object limit of " << maxObjects << " reached, not adding\n";
+    return false;
+  }
+
   unsigned int objId = 0;
   if (!sceneTree.empty())
     objId = sceneTree.back().id + 1;
   sceneTree.push_back(Object{objId, "Object " + std::to_string(objId), shape});
   std::cout << "[Scene] Added object: type=" << shape << "\n";
+  return true;
+}
+
+void Scene::fillBenchmark(unsigned int count) {
+  if (count > maxObjects) {
+    std::cerr << "[Scene] Benchmark clamped to the object limit of " << maxObjects << "\n";
+    count = static_cast<unsigned int>(maxObjects);
+  }
+
+  deselectObjects();
+  sceneTree.clear();
+  sceneTree.reserve(count);
+  markAllDirty();
+
+  // cube grid centered on the origin, deterministic so runs are comparable
+  const float spacing = 3.0f;
+  int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(count))));
+  float offset = 0.5f * spacing * static_cast<float>(side - 1);
+  for (unsigned int i = 0; i < count; i++) {
+    Object obj{i, "Object " + std::to_string(i), (i % 2 == 0) ? BOX : SPHERE};
+    obj.position = glm::vec3(i % side, (i / side) % side, i / (side * side)) * spacing - offset;
+    obj.rotation = glm::vec3(0.3f * static_cast<float>(i % 7), 0.2f * static_cast<float>(i % 5), 0.0f);
+    obj.scale = glm::vec3(0.5f + 0.1f * static_cast<float>(i % 4));
+    sceneTree.push_back(obj);
+  }
+  std::cout << "[Scene] Filled benchmark scene with " << count << " objects\n";
+}
+
+bool Scene::reserveObjects(unsigned long count) {
+  count = std::min(count, maxObjects);
+  if (count <= objectCapacity)
+    return false;
+
+  objectCapacity = std::min(std::max(count, objectCapacity * 2), maxObjects);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSsbo);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, objectHeaderSize + static_cast<GLsizeiptr>(objectCapacity * sizeof(ObjectUboData)), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectSsbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  std::cout << "[Scene] Resized object buffer to " << objectCapacity << " objects\n";
+  return true;
+}
+
+unsigned long Scene::getObjectCapacity() const { return objectCapacity; }
+
+unsigned long Scene::getMaxObjects() const { return maxObjects; }
+
+unsigned long Scene::getLastUploadCount() const { return lastUploadCount; }
+
+const std::vector<ObjectUboData>& Scene::getObjectData() const { return objectData; }
+
+void Scene::markDirty(unsigned long index) {
+  if (index >= dirtyObjects.size())
+    dirtyObjects.resize(index + 1, 0);
+  dirtyObjects[index] = 1;
 }
 
+void Scene::markDirtyFrom(unsigned long index) { dirtyFrom = std::min(dirtyFrom, index); }
+
+void Scene::markAllDirty() { dirtyFrom = 0; }
+
 void Scene::deleteObject(unsigned int index) {
-  sceneTree.erase(sceneTree.begin() + index);
   std::cout << "[Scene] Deleted object: id=" << sceneTree[index].id << "\n";
+  sceneTree.erase(sceneTree.begin() + index);
+
+  // the selection index follows the objects that moved down
+  if (lastSelectedObjectIndex == static_cast<int>(index))
+    lastSelectedObjectIndex = -1;
+  else if (lastSelectedObjectIndex > static_cast<int>(index))
+    lastSelectedObjectIndex--;
+  markDirtyFrom(index);
 }
 
-void Scene::updateObjectUbo() {
-  std::vector<ObjectUboData> objectData;
+// bounding sphere of the unit shape, scaled and moved like applyTransform in main.fsh
+glm::vec4 objectBound(const Object& obj) {
+  float radius = obj.type == BOX ? std::sqrt(3.0f) : 1.0f;
+  glm::vec3 scale = glm::abs(obj.scale);
+  return glm::vec4(obj.position, radius * std::max({scale.x, scale.y, scale.z}));
+}
 
-  for (const auto& obj : sceneTree) {
-    ObjectUboData data;
+bool Scene::updateObjectUbo() {
+  // projects can hold more objects than this GPU can store
+  unsigned long objectsNum = std::min<unsigned long>(sceneTree.size(), maxObjects);
+  if (objectsNum < sceneTree.size() && !overflowReported) {
+    std::cerr << "[Scene] " << sceneTree.size() << " objects exceed the limit of " << maxObjects << ", the rest are not rendered\n";
+    overflowReported = true;
+  }
+
+  // added or removed objects, a new buffer starts out empty
+  bool countChanged = objectsNum != objectData.size() || bvh.nodes.empty();
+  if (countChanged)
+    markDirtyFrom(std::min<unsigned long>(objectsNum, objectData.size()));
+  if (reserveObjects(objectsNum))
+    markAllDirty();
+
+  objectData.resize(objectsNum);
+  objectBounds.resize(objectsNum);
+  dirtyObjects.resize(objectsNum, 0);
+  for (unsigned long i = dirtyFrom; i < objectsNum; i++)
+    dirtyObjects[i] = 1;
+  dirtyFrom = std::numeric_limits<unsigned long>::max();
+
+  // recompute dirty objects, merged into contiguous upload ranges
+  std::vector<std::pair<unsigned long, unsigned long>> ranges;
+  for (unsigned long i = 0; i < objectsNum; i++) {
+    if (dirtyObjects[i] == 0)
+      continue;
+    dirtyObjects[i] = 0;
+
+    const Object& obj = sceneTree[i];
+    ObjectUboData& data = objectData[i];
     data.transformation = constructTransformationMat(obj.position, obj.scale, obj.rotation);
     data.typeMatIdMode = glm::ivec4(obj.type, obj.matId, obj.mode, 0);
-    objectData.push_back(data);
+    objectBounds[i] = objectBound(obj);
+
+    if (!ranges.empty() && ranges.back().first + ranges.back().second == i)
+      ranges.back().second++;
+    else
+      ranges.emplace_back(i, 1);
   }
 
-  glBindBuffer(GL_UNIFORM_BUFFER, objectUbo);
+  lastUploadCount = 0;
+  if (ranges.empty() && !countChanged)
+    return false;
+
+  bvh.update(objectBounds);
+  bvh.upload();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSsbo);
 
   // member offset size
   // int    0      4
   // -      -      12 <- padding (required to keep offsets be multiple of 16
   // obj    16     -
-  unsigned long objectsNum = objectData.size();
-  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int), &objectsNum);
-  glBufferSubData(GL_UNIFORM_BUFFER, 16, static_cast<long>(objectsNum * sizeof(ObjectUboData)), objectData.data());
-
-  glBindBufferRange(GL_UNIFORM_BUFFER, 0, objectUbo, 0, static_cast<long>(16 + (objectsNum * sizeof(ObjectUboData))));
+  int count = static_cast<int>(objectsNum);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(int), &count);
+  for (const auto& [first, num] : ranges) {
+    auto offset = objectHeaderSize + static_cast<GLintptr>(first * sizeof(ObjectUboData));
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, static_cast<GLsizeiptr>(num * sizeof(ObjectUboData)), &objectData[first]);
+    lastUploadCount += num;
+  }
 
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return true;
 }
 /*
      void updateMaterialUBO() {
@@ -74,7 +195,10 @@ void Scene::updateObjectUbo() {
      }
 */
 
-void Scene::modifyObjectPosition(unsigned int id, glm::vec3 position) { sceneTree[id].position = position; }
+void Scene::modifyObjectPosition(unsigned int id, glm::vec3 position) {
+  sceneTree[id].position = position;
+  markDirty(id);
+}
 
 glm::mat4 Scene::constructTransformationMat(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation) {
   glm::vec3 s = glm::sin(rotation);
@@ -91,6 +215,7 @@ glm::mat4 Scene::constructTransformationMat(glm::vec3 position, glm::vec3 scale,
 void Scene::selectObject(unsigned int index) {
   deselectObjects();
   sceneTree[index].mode = 1;
+  markDirty(index);
   lastSelectedObjectIndex = static_cast<int>(index);
   std::cout << "[Scene] Selected object: id=" << sceneTree[index].id << "\n";
 }
@@ -98,6 +223,7 @@ void Scene::selectObject(unsigned int index) {
 void Scene::deselectObjects() {
   if (lastSelectedObjectIndex >= 0) {
     sceneTree[lastSelectedObjectIndex].mode = 0;
+    markDirty(lastSelectedObjectIndex);
     lastSelectedObjectIndex = -1;
   }
 }
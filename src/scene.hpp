@@ -1,6 +1,7 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <limits>
 #include <map>
 #include <string>
 #include <vector>
@@ -9,6 +10,8 @@
 
 #include <glm/glm.hpp>
 
+#include "bvh.hpp"
+
 struct Object {
   unsigned int id;
   std::string name;
@@ -34,6 +37,7 @@ struct MaterialUboData {
   glm::vec4 color;
 };
 
+// std430 layout, matches ObjectUboData in main.fsh
 struct ObjectUboData {
   glm::mat4 transformation; // not a composite matrix
   glm::ivec4 typeMatIdMode; // x=type, y=mat_id, z=mode, w is for padding
@@ -56,25 +60,54 @@ public:
   std::vector<Object> sceneTree;
   std::map<unsigned int, Material> materials; // id, mat
 
-  GLuint objectUbo;
+  GLuint objectSsbo; // objectsCount followed by ObjectUboData of every object
   GLuint materialUbo;
 
+  Bvh bvh;
+
   Scene();
 
-  void addObject(Shape shape);
+  bool addObject(Shape shape); // false once maxObjects is reached
+
+  // replaces the scene with count objects on a grid, for measuring scaling
+  void fillBenchmark(unsigned int count);
 
   void modifyObjectPosition(unsigned int id, glm::vec3 position);
 
   void deleteObject(unsigned int index);
 
-  void updateObjectUbo();
+  bool updateObjectUbo(); // true if anything was uploaded
 
   void selectObject(unsigned int index);
 
   void deselectObjects();
 
+  // changes made to sceneTree directly have to be flagged for the next upload
+  void markDirty(unsigned long index);
+  void markDirtyFrom(unsigned long index); // every object from index on
+  void markAllDirty();
+
+  unsigned long getObjectCapacity() const;
+  unsigned long getMaxObjects() const;
+  unsigned long getLastUploadCount() const; // objects uploaded by the last updateObjectUbo
+  const std::vector<ObjectUboData>& getObjectData() const; // as uploaded, indexed by bvh.objects
+
 private:
+  static constexpr GLsizeiptr objectHeaderSize = 16; // objectsCount padded to the array alignment
+
   int lastSelectedObjectIndex = -1;
+  unsigned long objectCapacity = 0;
+  unsigned long maxObjects = 0; // limited by GL_MAX_SHADER_STORAGE_BLOCK_SIZE
+  bool overflowReported = false;
+
+  // what the GPU holds, one entry per uploaded object
+  std::vector<ObjectUboData> objectData;
+  std::vector<glm::vec4> objectBounds;
+  std::vector<char> dirtyObjects;
+  unsigned long dirtyFrom = 0; // objects from here on are all dirty
+  unsigned long lastUploadCount = 0;
+
+  bool reserveObjects(unsigned long count); // true if the buffer was reallocated
 
   glm::mat4 constructTransformationMat(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation);
 };
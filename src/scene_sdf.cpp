@@ -0,0 +1,85 @@
+#include "scene_sdf.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+
+constexpr float floatMax = 1e10f; // FLOAT_MAX
+constexpr int bvhStackSize = 32;  // BVH_STACK_SIZE
+
+float sdfShape(const glm::vec3& p, int type) {
+  switch (type) {
+  case 0: {
+    glm::vec3 q = glm::abs(p) - 1.0f;
+    return glm::length(glm::max(q, 0.0f)) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+  }
+  case 1:
+    return glm::length(p) - 1.0f;
+  default:
+    return floatMax;
+  }
+}
+
+glm::vec3 applyTransform(glm::vec3 p, const glm::mat4& t) {
+  p += glm::vec3(t[0][3], t[1][3], t[2][3]);
+  p = glm::mat3(t) * p;
+  p *= glm::vec3(t[3][0], t[3][1], t[3][2]);
+  return p;
+}
+
+float aabbDist(const glm::vec3& p, const glm::vec3& lo, const glm::vec3& hi) { return glm::length(glm::max(glm::max(lo - p, p - hi), 0.0f)); }
+
+} // namespace
+
+bool SceneSdf::load(const NodeEditor& nodeEditor, const Scene& scene) {
+  objects = scene.getObjectData();
+  bvhNodes = scene.bvh.nodes;
+  bvhObjects = scene.bvh.objects;
+  return compileSdfTape(nodeEditor.getNodes(), tape);
+}
+
+void SceneSdf::evaluate(const float* x, const float* y, const float* z, float* distances, size_t count) const {
+  tape.evaluate(x, y, z, distances, count, time);
+  if (objects.empty())
+    return;
+  for (size_t i = 0; i < count; i++)
+    closestObject(glm::vec3(x[i], y[i], z[i]), distances[i]);
+}
+
+float SceneSdf::evaluate(const glm::vec3& p) const {
+  float d;
+  evaluate(&p.x, &p.y, &p.z, &d, 1);
+  return d;
+}
+
+const ObjectUboData* SceneSdf::closestObject(const glm::vec3& p, float& f) const {
+  if (objects.empty() || bvhNodes.empty())
+    return nullptr;
+
+  // only objects whose bounds are closer than the best distance so far are evaluated
+  const ObjectUboData* closest = nullptr;
+  std::array<int, bvhStackSize> stack;
+  int sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const BvhNode& node = bvhNodes[stack[--sp]];
+    if (aabbDist(p, node.aabbMin, node.aabbMax) > f)
+      continue;
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        const ObjectUboData& obj = objects[bvhObjects[i]];
+        float dist = sdfShape(applyTransform(p, obj.transformation), obj.typeMatIdMode.x);
+        if (!(f < dist)) {
+          f = dist;
+          closest = &obj;
+        }
+      }
+    } else {
+      stack[sp++] = node.first + 1;
+      stack[sp++] = node.first;
+    }
+  }
+  return closest;
+}
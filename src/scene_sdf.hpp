@@ -0,0 +1,36 @@
+#ifndef SCENE_SDF_H
+#define SCENE_SDF_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "node_graph.hpp"
+#include "scene.hpp"
+#include "sdf_tape.hpp"
+
+// sceneSdf of main.fsh on the CPU: the node graph distance tape combined with the scene objects
+// through the BVH. load() takes copies, so worker threads can evaluate while the editor goes on.
+class SceneSdf {
+public:
+  float time = 0.0f; // uTime
+
+  // false for graphs with code nodes, objects are taken as last uploaded by Scene
+  bool load(const NodeEditor& nodeEditor, const Scene& scene);
+
+  void evaluate(const float* x, const float* y, const float* z, float* distances, size_t count) const;
+  float evaluate(const glm::vec3& p) const;
+
+  // the object closer than f, f becomes its distance. nullptr if the node graph is closer, ties
+  // go to the object like uSurf.
+  const ObjectUboData* closestObject(const glm::vec3& p, float& f) const;
+
+private:
+  SdfTape tape;
+  std::vector<ObjectUboData> objects;
+  std::vector<BvhNode> bvhNodes;
+  std::vector<int> bvhObjects;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "sdf_counters.hpp"
+
+SdfCounters::SdfCounters() {
+  glGenBuffers(ringFrames, buffers.data());
+  for (GLuint buffer : buffers) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counts), nullptr, GL_DYNAMIC_READ);
+  }
+
+  // main.fsh always declares the block, keep something bound
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[0]);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+SdfCounters::~SdfCounters() {
+  for (GLsync fence : fences) {
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  }
+  glDeleteBuffers(ringFrames, buffers.data());
+}
+
+void SdfCounters::beginFrame() {
+  slot = (slot + 1) % ringFrames;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[slot]);
+
+  // a frame that hasn't finished yet is skipped rather than waited for
+  if (fences[slot] != nullptr) {
+    GLenum status = glClientWaitSync(fences[slot], 0, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+      glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts.data());
+    glDeleteSync(fences[slot]);
+    fences[slot] = nullptr;
+  }
+
+  GLuint zero = 0;
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[slot]);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void SdfCounters::endFrame() {
+  // shader writes have to be visible to glGetBufferSubData
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+unsigned long SdfCounters::getTotal() const {
+  unsigned long total = 0;
+  for (unsigned int count : counts)
+    total += count;
+  return total;
+}
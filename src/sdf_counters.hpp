@@ -0,0 +1,36 @@
+#ifndef SDF_COUNTERS_H
+#define SDF_COUNTERS_H
+
+#include <array>
+
+#include <glad/glad.h>
+
+// SDF evaluations per frame, summed by main.fsh with atomics into a shader storage
+// buffer. One buffer per frame in a ring, read back once its fence has passed so
+// the CPU never waits. Counts are 32 bit and wrap past ~4e9 evaluations a frame.
+class SdfCounters {
+public:
+  static constexpr GLuint binding = 4;
+  static constexpr int ringFrames = 3;
+
+  // matches the EVAL_* defines in main.fsh
+  static constexpr int categories = 5;
+  static constexpr std::array<const char*, categories> names = {"Primary", "Shadow", "Reflection", "Normal", "Occlusion"};
+
+  std::array<unsigned int, categories> counts = {}; // last frame that was read back
+
+  SdfCounters();
+  ~SdfCounters();
+
+  void beginFrame(); // reads back a finished frame, then clears and binds a buffer for this one
+  void endFrame();
+
+  unsigned long getTotal() const;
+
+private:
+  std::array<GLuint, ringFrames> buffers = {};
+  std::array<GLsync, ringFrames> fences = {};
+  int slot = 0;
+};
+
+#endif
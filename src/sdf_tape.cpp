@@ -0,0 +1,725 @@
+#include "sdf_tape.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+int arity(SdfTape::Op op) {
+  switch (op) {
+  case SdfTape::NEG:
+  case SdfTape::ABS:
+  case SdfTape::SQRT:
+  case SdfTape::SIN:
+  case SdfTape::COS:
+    return 1;
+  case SdfTape::SELECT_LT:
+    return 4;
+  default:
+    return 2;
+  }
+}
+
+float apply(SdfTape::Op op, float a, float b, float c, float d) {
+  switch (op) {
+  case SdfTape::ADD:
+    return a + b;
+  case SdfTape::SUB:
+    return a - b;
+  case SdfTape::MUL:
+    return a * b;
+  case SdfTape::DIV:
+    return a / b;
+  case SdfTape::MIN:
+    return std::min(a, b);
+  case SdfTape::MAX:
+    return std::max(a, b);
+  case SdfTape::NEG:
+    return -a;
+  case SdfTape::ABS:
+    return std::abs(a);
+  case SdfTape::SQRT:
+    return std::sqrt(a);
+  case SdfTape::SIN:
+    return std::sin(a);
+  case SdfTape::COS:
+    return std::cos(a);
+  case SdfTape::SELECT_LT:
+    return a < b ? c : d;
+  }
+  return 0.0f;
+}
+
+// the lanes of one register
+struct alignas(32) Row {
+  float v[SdfTape::batchSize];
+};
+
+namespace simd {
+#if defined(__AVX__)
+using Vec = __m256;
+constexpr int width = 8;
+inline Vec load(const float* p) { return _mm256_load_ps(p); }
+inline void store(float* p, Vec x) { _mm256_store_ps(p, x); }
+inline Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+inline Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+inline Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+inline Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+inline Vec neg(Vec a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+inline Vec abs(Vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+inline Vec sqrt(Vec a) { return _mm256_sqrt_ps(a); }
+inline Vec selectLt(Vec a, Vec b, Vec c, Vec d) { return _mm256_blendv_ps(d, c, _mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+#elif defined(__SSE2__)
+using Vec = __m128;
+constexpr int width = 4;
+inline Vec load(const float* p) { return _mm_load_ps(p); }
+inline void store(float* p, Vec x) { _mm_store_ps(p, x); }
+inline Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+inline Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+inline Vec min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+inline Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+inline Vec neg(Vec a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline Vec abs(Vec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline Vec sqrt(Vec a) { return _mm_sqrt_ps(a); }
+inline Vec selectLt(Vec a, Vec b, Vec c, Vec d) {
+  Vec mask = _mm_cmplt_ps(a, b);
+  return _mm_or_ps(_mm_and_ps(mask, c), _mm_andnot_ps(mask, d));
+}
+#else
+using Vec = float;
+constexpr int width = 1;
+inline Vec load(const float* p) { return *p; }
+inline void store(float* p, Vec x) { *p = x; }
+inline Vec add(Vec a, Vec b) { return a + b; }
+inline Vec sub(Vec a, Vec b) { return a - b; }
+inline Vec mul(Vec a, Vec b) { return a * b; }
+inline Vec div(Vec a, Vec b) { return a / b; }
+inline Vec min(Vec a, Vec b) { return std::min(a, b); }
+inline Vec max(Vec a, Vec b) { return std::max(a, b); }
+inline Vec neg(Vec a) { return -a; }
+inline Vec abs(Vec a) { return std::abs(a); }
+inline Vec sqrt(Vec a) { return std::sqrt(a); }
+inline Vec selectLt(Vec a, Vec b, Vec c, Vec d) { return a < b ? c : d; }
+#endif
+} // namespace simd
+
+static_assert(SdfTape::batchSize % simd::width == 0, "batches must be whole SIMD vectors");
+
+template <typename F> inline void lanes(float* dst, const float* a, F f) {
+  for (int l = 0; l < SdfTape::batchSize; l += simd::width)
+    simd::store(dst + l, f(simd::load(a + l)));
+}
+
+template <typename F> inline void lanes(float* dst, const float* a, const float* b, F f) {
+  for (int l = 0; l < SdfTape::batchSize; l += simd::width)
+    simd::store(dst + l, f(simd::load(a + l), simd::load(b + l)));
+}
+
+void run(const std::vector<SdfTape::Instruction>& instructions, std::vector<Row>& rows) {
+  for (const auto& ins : instructions) {
+    float* dst = rows[ins.dst].v;
+    const float* a = rows[ins.a].v;
+    const float* b = rows[ins.b].v;
+    switch (ins.op) {
+    case SdfTape::ADD:
+      lanes(dst, a, b, simd::add);
+      break;
+    case SdfTape::SUB:
+      lanes(dst, a, b, simd::sub);
+      break;
+    case SdfTape::MUL:
+      lanes(dst, a, b, simd::mul);
+      break;
+    case SdfTape::DIV:
+      lanes(dst, a, b, simd::div);
+      break;
+    case SdfTape::MIN:
+      lanes(dst, a, b, simd::min);
+      break;
+    case SdfTape::MAX:
+      lanes(dst, a, b, simd::max);
+      break;
+    case SdfTape::NEG:
+      lanes(dst, a, simd::neg);
+      break;
+    case SdfTape::ABS:
+      lanes(dst, a, simd::abs);
+      break;
+    case SdfTape::SQRT:
+      lanes(dst, a, simd::sqrt);
+      break;
+    case SdfTape::SIN: // no vector sin in SSE/AVX
+      for (int l = 0; l < SdfTape::batchSize; l++)
+        dst[l] = std::sin(a[l]);
+      break;
+    case SdfTape::COS:
+      for (int l = 0; l < SdfTape::batchSize; l++)
+        dst[l] = std::cos(a[l]);
+      break;
+    case SdfTape::SELECT_LT: {
+      const float* c = rows[ins.c].v;
+      const float* d = rows[ins.d].v;
+      for (int l = 0; l < SdfTape::batchSize; l += simd::width)
+        simd::store(dst + l, simd::selectLt(simd::load(a + l), simd::load(b + l), simd::load(c + l), simd::load(d + l)));
+      break;
+    }
+    }
+  }
+}
+
+} // namespace
+
+void SdfTape::clear() {
+  instructions.clear();
+  constants.clear();
+  results.clear();
+  registerCount = 0;
+  valid = false;
+
+  constantIndex.assign(fixedRegisters, -1);
+  constantRegisters.clear();
+  overflow = false;
+}
+
+uint16_t SdfTape::newRegister(int constant) {
+  if (constantIndex.size() >= 0xFFFF) {
+    overflow = true;
+    return 0;
+  }
+  constantIndex.push_back(constant);
+  return static_cast<uint16_t>(constantIndex.size() - 1);
+}
+
+bool SdfTape::isConstant(uint16_t reg, float& value) const {
+  if (reg >= constantIndex.size() || constantIndex[reg] < 0)
+    return false;
+  value = constants[constantIndex[reg]];
+  return true;
+}
+
+uint16_t SdfTape::constant(float value) {
+  auto bits = std::bit_cast<uint32_t>(value);
+  if (auto it = constantRegisters.find(bits); it != constantRegisters.end())
+    return it->second;
+
+  uint16_t reg = newRegister(static_cast<int>(constants.size()));
+  constants.push_back(value);
+  constantRegisters[bits] = reg;
+  return reg;
+}
+
+uint16_t SdfTape::emit(Op op, uint16_t a, uint16_t b, uint16_t c, uint16_t d) {
+  // parameters are constants, whatever only depends on them is folded
+  const uint16_t operands[4] = {a, b, c, d};
+  float values[4] = {};
+  bool folded = true;
+  for (int i = 0; i < arity(op); i++)
+    folded = folded && isConstant(operands[i], values[i]);
+  if (folded)
+    return constant(apply(op, values[0], values[1], values[2], values[3]));
+
+  // identities that come up with default inputs, like pos-vec3(0)
+  float value;
+  if ((op == ADD || op == SUB) && isConstant(b, value) && value == 0.0f)
+    return a;
+  if (op == ADD && isConstant(a, value) && value == 0.0f)
+    return b;
+  if ((op == MUL || op == DIV) && isConstant(b, value) && value == 1.0f)
+    return a;
+  if (op == MUL && isConstant(a, value) && value == 1.0f)
+    return b;
+  if (op == SELECT_LT && c == d)
+    return c;
+
+  uint16_t dst = newRegister(-1);
+  instructions.push_back({op, dst, a, b, c, d});
+  return dst;
+}
+
+bool SdfTape::finalize(uint16_t result) { return finalize(std::vector<uint16_t>{result}); }
+
+bool SdfTape::finalize(const std::vector<uint16_t>& resultRegisters) {
+  valid = false;
+  if (overflow)
+    return false;
+  size_t virtualCount = constantIndex.size();
+
+  // dead code elimination, backwards from the results
+  std::vector<char> live(virtualCount, 0);
+  for (uint16_t r : resultRegisters)
+    live[r] = 1;
+  std::vector<Instruction> kept;
+  for (auto it = instructions.rbegin(); it != instructions.rend(); ++it) {
+    if (live[it->dst] == 0)
+      continue;
+    const uint16_t operands[4] = {it->a, it->b, it->c, it->d};
+    for (int i = 0; i < arity(it->op); i++)
+      live[operands[i]] = 1;
+    kept.push_back(*it);
+  }
+  std::reverse(kept.begin(), kept.end());
+
+  std::vector<int> lastUse(virtualCount, -1);
+  for (size_t i = 0; i < kept.size(); i++) {
+    const uint16_t operands[4] = {kept[i].a, kept[i].b, kept[i].c, kept[i].d};
+    for (int j = 0; j < arity(kept[i].op); j++)
+      lastUse[operands[j]] = static_cast<int>(i);
+  }
+  for (uint16_t r : resultRegisters)
+    lastUse[r] = static_cast<int>(kept.size());
+
+  // fixed registers and the live constants keep their own rows
+  std::vector<uint16_t> physical(virtualCount, 0);
+  for (uint16_t r = 0; r < fixedRegisters; r++)
+    physical[r] = r;
+  std::vector<float> usedConstants;
+  for (size_t v = fixedRegisters; v < virtualCount; v++) {
+    if (constantIndex[v] >= 0 && live[v] != 0) {
+      physical[v] = static_cast<uint16_t>(fixedRegisters + usedConstants.size());
+      usedConstants.push_back(constants[constantIndex[v]]);
+    }
+  }
+
+  // computed values share rows, a row is free again after its last reader
+  size_t next = fixedRegisters + usedConstants.size();
+  std::vector<uint16_t> freeRows;
+  for (size_t i = 0; i < kept.size(); i++) {
+    Instruction& ins = kept[i];
+    uint16_t* operands[4] = {&ins.a, &ins.b, &ins.c, &ins.d};
+    for (int j = 0; j < arity(ins.op); j++) {
+      uint16_t v = *operands[j];
+      *operands[j] = physical[v];
+      // every lane is read before it is written, so dst may reuse an operand row
+      if (v >= fixedRegisters && constantIndex[v] < 0 && lastUse[v] == static_cast<int>(i)) {
+        freeRows.push_back(physical[v]);
+        lastUse[v] = -1;
+      }
+    }
+
+    if (freeRows.empty()) {
+      physical[ins.dst] = static_cast<uint16_t>(next++);
+    } else {
+      physical[ins.dst] = freeRows.back();
+      freeRows.pop_back();
+    }
+    ins.dst = physical[ins.dst];
+  }
+  if (next > 0xFFFF)
+    return false;
+
+  instructions = std::move(kept);
+  constants = std::move(usedConstants);
+  results.clear();
+  for (uint16_t r : resultRegisters)
+    results.push_back(physical[r]);
+  registerCount = static_cast<int>(next);
+  valid = true;
+
+  constantIndex.clear();
+  constantRegisters.clear();
+  return true;
+}
+
+void SdfTape::evaluate(const float* x, const float* y, const float* z, float* distances, size_t count, float time) const {
+  evaluate(x, y, z, std::span(&distances, 1), count, time);
+}
+
+float SdfTape::evaluate(const glm::vec3& p, float time) const {
+  float d;
+  evaluate(&p.x, &p.y, &p.z, &d, 1, time);
+  return d;
+}
+
+void SdfTape::evaluate(const float* x, const float* y, const float* z, std::span<float* const> outputs, size_t count, float time) const {
+  if (!valid) {
+    for (float* output : outputs)
+      std::fill_n(output, count, 1e10f);
+    return;
+  }
+
+  thread_local std::vector<Row> rows;
+  if (rows.size() < static_cast<size_t>(registerCount))
+    rows.resize(registerCount);
+  std::fill_n(rows[timeRegister].v, batchSize, time);
+  for (size_t i = 0; i < constants.size(); i++)
+    std::fill_n(rows[fixedRegisters + i].v, batchSize, constants[i]);
+
+  for (size_t first = 0; first < count; first += batchSize) {
+    size_t n = std::min<size_t>(batchSize, count - first);
+    // a partial batch repeats its last point
+    for (size_t l = 0; l < batchSize; l++) {
+      size_t src = first + std::min(l, n - 1);
+      rows[posRegister].v[l] = x[src];
+      rows[posRegister + 1].v[l] = y[src];
+      rows[posRegister + 2].v[l] = z[src];
+    }
+    run(instructions, rows);
+    for (size_t i = 0; i < std::min(results.size(), outputs.size()); i++)
+      std::copy_n(rows[results[i]].v, n, outputs[i] + first);
+  }
+}
+
+bool SdfTape::isValid() const { return valid; }
+
+size_t SdfTape::getInstructionCount() const { return instructions.size(); }
+
+int SdfTape::getRegisterCount() const { return registerCount; }
+
+size_t SdfTape::getOutputCount() const { return results.size(); }
+
+namespace {
+
+using Op = SdfTape::Op;
+
+// vec3 values take three registers, scalars repeat theirs so they broadcast like in GLSL
+struct TapeValue {
+  uint16_t x, y, z;
+};
+
+// Surface of main.fsh, selected is always 0 for node surfaces
+struct TapeSurface {
+  uint16_t dist, r, g, b, roughness;
+};
+
+// Mirrors the distance only GLSL of each node, see the generateGlsl of its definition
+// and the sdf* functions in main.fsh.
+class TapeCompiler {
+public:
+  SdfTape& tape;
+  bool failed = false;
+
+  TapeCompiler(SdfTape& tape) : tape(tape) {}
+
+  uint16_t op(Op o, uint16_t a, uint16_t b = 0, uint16_t c = 0, uint16_t d = 0) { return tape.emit(o, a, b, c, d); }
+  TapeValue op(Op o, TapeValue a, TapeValue b) { return {op(o, a.x, b.x), op(o, a.y, b.y), op(o, a.z, b.z)}; }
+
+  uint16_t constant(float v) { return tape.constant(v); }
+  TapeValue scalar(uint16_t r) { return {r, r, r}; }
+  TapeValue vec3(const glm::vec3& v) { return {constant(v.x), constant(v.y), constant(v.z)}; }
+  TapeValue data(const Node* node, int loc) { return scalar(constant(node->data[loc])); }
+  TapeValue dataVec3(const Node* node, int loc) { return vec3(glm::vec3(node->data[loc], node->data[loc + 1], node->data[loc + 2])); }
+
+  uint16_t dot(TapeValue a, TapeValue b) { return op(Op::ADD, op(Op::ADD, op(Op::MUL, a.x, b.x), op(Op::MUL, a.y, b.y)), op(Op::MUL, a.z, b.z)); }
+  uint16_t dot2(uint16_t x, uint16_t y) { return op(Op::ADD, op(Op::MUL, x, x), op(Op::MUL, y, y)); }
+  uint16_t length(TapeValue a) { return op(Op::SQRT, dot(a, a)); }
+  uint16_t length(uint16_t x, uint16_t y) { return op(Op::SQRT, dot2(x, y)); }
+  uint16_t clamp(uint16_t x, float lo, float hi) { return op(Op::MIN, op(Op::MAX, x, constant(lo)), constant(hi)); }
+  uint16_t mix(uint16_t a, uint16_t b, uint16_t k) { return op(Op::ADD, a, op(Op::MUL, op(Op::SUB, b, a), k)); }
+
+  // the linked input or the fallback, like Node::pin0GenerateGlsl
+  TapeValue input(const Node* node, int index, TapeValue fallback) {
+    const auto& pins = node->inputs[index].pins;
+    return pins.empty() ? fallback : compile(pins[0]);
+  }
+
+  // primitives are placed at pos-position unless the position input is linked
+  TapeValue primitivePos(const Node* node) { return input(node, 2, op(Op::SUB, scalarPos(), dataVec3(node, 4))); }
+  TapeValue scalarPos() { return {SdfTape::posRegister, SdfTape::posRegister + 1, SdfTape::posRegister + 2}; }
+
+  uint16_t sdfSphere(TapeValue p, uint16_t r) { return op(Op::SUB, length(p), r); }
+
+  uint16_t sdfBox(TapeValue p, TapeValue b, uint16_t r) {
+    TapeValue q = op(Op::ADD, op(Op::SUB, TapeValue{op(Op::ABS, p.x), op(Op::ABS, p.y), op(Op::ABS, p.z)}, b), scalar(r));
+    TapeValue zero = scalar(constant(0.0f));
+    uint16_t outside = length(op(Op::MAX, q, zero));
+    uint16_t inside = op(Op::MIN, op(Op::MAX, q.x, op(Op::MAX, q.y, q.z)), zero.x);
+    return op(Op::SUB, op(Op::ADD, outside, inside), r);
+  }
+
+  uint16_t sdfCylinder(TapeValue p, uint16_t ra, uint16_t h, uint16_t rb) {
+    uint16_t zero = constant(0.0f);
+    uint16_t dx = op(Op::ADD, op(Op::SUB, length(p.x, p.z), op(Op::MUL, constant(2.0f), ra)), rb);
+    uint16_t dy = op(Op::ADD, op(Op::SUB, op(Op::ABS, p.y), h), rb);
+    uint16_t inside = op(Op::MIN, op(Op::MAX, dx, dy), zero);
+    uint16_t outside = length(op(Op::MAX, dx, zero), op(Op::MAX, dy, zero));
+    return op(Op::SUB, op(Op::ADD, inside, outside), rb);
+  }
+
+  uint16_t sdfTorus(TapeValue p, uint16_t r, uint16_t t) { return op(Op::SUB, length(op(Op::SUB, length(p.x, p.z), r), p.y), t); }
+
+  uint16_t sdfPlane(TapeValue p, TapeValue n) { return dot(p, n); }
+
+  uint16_t sdfCappedCone(TapeValue p, uint16_t h, uint16_t r1, uint16_t r2, uint16_t r) {
+    uint16_t zero = constant(0.0f);
+    h = op(Op::SUB, h, r);
+    uint16_t py = op(Op::ADD, p.y, op(Op::MUL, constant(0.5f), r));
+    r1 = op(Op::MAX, op(Op::SUB, r1, r), zero);
+    r2 = op(Op::MAX, op(Op::SUB, r2, r), zero);
+    uint16_t qx = length(p.x, p.z);
+    uint16_t qy = op(Op::NEG, py);
+    uint16_t k2x = op(Op::SUB, r2, r1);
+    uint16_t k2y = op(Op::MUL, constant(2.0f), h);
+    uint16_t cax = op(Op::SUB, qx, op(Op::MIN, qx, op(Op::SELECT_LT, qy, zero, r1, r2)));
+    uint16_t cay = op(Op::SUB, op(Op::ABS, qy), h);
+    uint16_t t = op(Op::DIV, op(Op::ADD, op(Op::MUL, op(Op::SUB, r2, qx), k2x), op(Op::MUL, op(Op::SUB, h, qy), k2y)), dot2(k2x, k2y));
+    t = clamp(t, 0.0f, 1.0f);
+    uint16_t cbx = op(Op::ADD, op(Op::SUB, qx, r2), op(Op::MUL, k2x, t));
+    uint16_t cby = op(Op::ADD, op(Op::SUB, qy, h), op(Op::MUL, k2y, t));
+    uint16_t one = constant(1.0f);
+    uint16_t s = op(Op::SELECT_LT, cbx, zero, op(Op::SELECT_LT, cay, zero, constant(-1.0f), one), one);
+    uint16_t dist = op(Op::SQRT, op(Op::MIN, dot2(cax, cay), dot2(cbx, cby)));
+    return op(Op::SUB, op(Op::MUL, s, dist), op(Op::MUL, constant(0.5f), r));
+  }
+
+  // blend weight of smin, smax and sdiff, w*k
+  // w of smin, smax and sdiff, their distance is offset by w*k
+  uint16_t smoothWeight(uint16_t diff, uint16_t k) {
+    uint16_t h = op(Op::SUB, constant(1.0f), op(Op::MIN, op(Op::DIV, op(Op::ABS, diff), op(Op::MUL, constant(4.0f), k)), constant(1.0f)));
+    return op(Op::MUL, h, h);
+  }
+  uint16_t smoothOffset(uint16_t diff, uint16_t k) { return op(Op::MUL, smoothWeight(diff, k), k); }
+  uint16_t smin(uint16_t a, uint16_t b, uint16_t k) { return op(Op::SUB, op(Op::MIN, a, b), smoothOffset(op(Op::SUB, a, b), k)); }
+  uint16_t smax(uint16_t a, uint16_t b, uint16_t k) { return op(Op::ADD, op(Op::MAX, a, b), smoothOffset(op(Op::SUB, a, b), k)); }
+  uint16_t sdiff(uint16_t a, uint16_t b, uint16_t k) { return op(Op::ADD, op(Op::MAX, a, op(Op::NEG, b)), smoothOffset(op(Op::ADD, a, b), k)); }
+
+  // material blends of mixSurfParams, select picks a where a < b
+  TapeSurface mixSurface(uint16_t dist, const TapeSurface& a, const TapeSurface& b, uint16_t m) {
+    return {dist, mix(a.r, b.r, m), mix(a.g, b.g, m), mix(a.b, b.b, m), mix(a.roughness, b.roughness, m)};
+  }
+  TapeSurface select(uint16_t lhs, uint16_t rhs, const TapeSurface& a, const TapeSurface& b) {
+    return {op(Op::SELECT_LT, lhs, rhs, a.dist, b.dist), op(Op::SELECT_LT, lhs, rhs, a.r, b.r), op(Op::SELECT_LT, lhs, rhs, a.g, b.g),
+            op(Op::SELECT_LT, lhs, rhs, a.b, b.b), op(Op::SELECT_LT, lhs, rhs, a.roughness, b.roughness)};
+  }
+
+  // uSurf, dSurf and iSurf of main.fsh
+  TapeSurface booleanSurface(float typef, bool smooth, uint16_t k, const TapeSurface& a, TapeSurface b) {
+    if (typef == 1.0f)
+      b.dist = op(Op::NEG, b.dist);
+    if (!smooth)
+      return typef == 0.0f ? select(a.dist, b.dist, a, b) : select(b.dist, a.dist, a, b);
+
+    // the dist of b is already negated for sdiff, which makes it smax
+    uint16_t w = smoothWeight(op(Op::SUB, a.dist, b.dist), k);
+    uint16_t s = op(Op::MUL, w, k);
+    uint16_t m = op(Op::MUL, w, constant(0.5f));
+    uint16_t oneMinusM = op(Op::SUB, constant(1.0f), m);
+    if (typef == 0.0f)
+      return mixSurface(op(Op::SUB, op(Op::MIN, a.dist, b.dist), s), a, b, op(Op::SELECT_LT, a.dist, b.dist, m, oneMinusM));
+    return mixSurface(op(Op::ADD, op(Op::MAX, a.dist, b.dist), s), a, b, op(Op::SELECT_LT, b.dist, a.dist, m, oneMinusM));
+  }
+
+  TapeSurface surface(const Pin* pin) {
+    unsigned long key = pin->id.Get();
+    if (auto it = surfaces.find(key); it != surfaces.end())
+      return it->second;
+
+    const Node* node = pin->node;
+    const auto& d = node->data;
+    uint16_t zero = constant(0.0f);
+    TapeSurface empty{constant(1e10f), zero, zero, zero, zero};
+    TapeSurface result = empty;
+    switch (node->getType()) {
+    case NodeType::SurfaceBoolean: {
+      const auto& i0 = node->inputs[0].pins;
+      if (i0.empty())
+        break;
+      result = surface(i0[0]);
+      for (const Pin* p : node->inputs[1].pins)
+        result = booleanSurface(d[0], d[1] > 0.0f, constant(d[1]), result, surface(p));
+      break;
+    }
+    case NodeType::SurfaceMix: {
+      const auto& a = node->inputs[0].pins;
+      const auto& b = node->inputs[1].pins;
+      TapeSurface sa = a.empty() ? empty : surface(a[0]);
+      TapeSurface sb = b.empty() ? empty : surface(b[0]);
+      uint16_t k = constant(d[0]);
+      result = mixSurface(mix(sa.dist, sb.dist, k), sa, sb, k);
+      break;
+    }
+    default: { // primitives, see surfaceGlsl
+      TapeValue color = input(node, 0, dataVec3(node, 0));
+      result = {compile(pin).x, color.x, color.y, color.z, input(node, 1, data(node, 3)).x};
+    }
+    }
+    surfaces[key] = result;
+    return result;
+  }
+
+  TapeValue compile(const Pin* pin) {
+    unsigned long key = pin->id.Get();
+    if (auto it = values.find(key); it != values.end())
+      return it->second;
+    TapeValue value = compileNode(pin);
+    values[key] = value;
+    return value;
+  }
+
+private:
+  std::unordered_map<unsigned long, TapeValue> values; // output pin id -> registers
+  std::unordered_map<unsigned long, TapeSurface> surfaces;
+
+  TapeValue compileNode(const Pin* pin) {
+    const Node* node = pin->node;
+    const auto& d = node->data;
+    TapeValue zero = scalar(constant(0.0f));
+    TapeValue empty = scalar(constant(1e10f)); // FLOAT_MAX
+
+    switch (node->getType()) {
+    case NodeType::SurfaceCreateSphere:
+      return scalar(sdfSphere(primitivePos(node), input(node, 3, data(node, 7)).x));
+    case NodeType::SurfaceCreateBox:
+      return scalar(sdfBox(primitivePos(node), input(node, 3, dataVec3(node, 7)), input(node, 4, data(node, 10)).x));
+    case NodeType::SurfaceCreateCylinder:
+      return scalar(sdfCylinder(primitivePos(node), input(node, 3, data(node, 7)).x, input(node, 4, data(node, 8)).x, input(node, 5, data(node, 9)).x));
+    case NodeType::SurfaceCreateTorus:
+      return scalar(sdfTorus(primitivePos(node), input(node, 3, data(node, 7)).x, input(node, 4, data(node, 8)).x));
+    case NodeType::SurfaceCreateCone:
+      return scalar(sdfCappedCone(primitivePos(node), input(node, 3, data(node, 7)).x, input(node, 4, data(node, 8)).x, input(node, 5, data(node, 9)).x,
+                                  input(node, 6, data(node, 10)).x));
+    case NodeType::SurfaceCreatePlane:
+      return scalar(sdfPlane(primitivePos(node), input(node, 3, dataVec3(node, 7))));
+    case NodeType::SurfaceBoolean: {
+      const auto& i0 = node->inputs[0].pins;
+      const auto& i1 = node->inputs[1].pins;
+      if (i0.empty())
+        return empty;
+      uint16_t result = compile(i0[0]).x;
+      uint16_t k = constant(d[1]);
+      bool smooth = d[1] > 0.0f;
+      for (const Pin* p : i1) {
+        uint16_t b = compile(p).x;
+        if (d[0] == 1.0f)
+          result = smooth ? sdiff(result, b, k) : op(Op::MAX, result, op(Op::NEG, b));
+        else if (d[0] == 2.0f)
+          result = smooth ? smax(result, b, k) : op(Op::MAX, result, b);
+        else
+          result = smooth ? smin(result, b, k) : op(Op::MIN, result, b);
+      }
+      return scalar(result);
+    }
+    case NodeType::SurfaceMix:
+      return scalar(mix(input(node, 0, empty).x, input(node, 1, empty).x, constant(d[0])));
+    case NodeType::Float:
+      return data(node, 0);
+    case NodeType::FloatSine:
+      return scalar(op(Op::SIN, op(Op::MUL, constant(d[0]), input(node, 0, zero).x)));
+    case NodeType::Vec3:
+      return dataVec3(node, 0);
+    case NodeType::Vec3Math: {
+      Op o = d[0] == 2.0f ? Op::DIV : (d[0] == 1.0f ? Op::MUL : Op::ADD);
+      return op(o, input(node, 0, zero), input(node, 1, zero));
+    }
+    case NodeType::Vec3Translate:
+      return op(Op::ADD, input(node, 0, zero), dataVec3(node, 0));
+    case NodeType::Vec3Scale:
+      return op(Op::MUL, input(node, 0, zero), dataVec3(node, 0));
+    case NodeType::Vec3Rotate: {
+      // p*rmat(r) in GLSL is a dot product with each column of rmat
+      glm::vec3 s = glm::sin(glm::vec3(d[0], d[1], d[2]));
+      glm::vec3 c = glm::cos(glm::vec3(d[0], d[1], d[2]));
+      glm::vec3 c0(c.y * c.z, s.x * s.y * c.z - c.x * s.z, c.x * s.y * c.z + s.x * s.z);
+      glm::vec3 c1(c.y * s.z, s.x * s.y * s.z + c.x * c.z, c.x * s.y * s.z - s.x * c.z);
+      glm::vec3 c2(-s.y, s.x * c.y, c.x * c.y);
+      TapeValue p = input(node, 0, zero);
+      return {dot(p, vec3(c0)), dot(p, vec3(c1)), dot(p, vec3(c2))};
+    }
+    case NodeType::Vec3Split: {
+      TapeValue v = input(node, 0, zero);
+      if (pin->id == node->outputs[0].id)
+        return scalar(v.x);
+      if (pin->id == node->outputs[1].id)
+        return scalar(v.y);
+      return scalar(v.z);
+    }
+    case NodeType::Vec3Combine:
+      return {input(node, 0, zero).x, input(node, 1, zero).x, input(node, 2, zero).x};
+    case NodeType::InputTime:
+      return scalar(SdfTape::timeRegister);
+    case NodeType::InputPosition:
+      return scalarPos();
+    default: // code nodes, and types that never feed a surface
+      failed = true;
+      return zero;
+    }
+  }
+};
+
+// finalizes the tape of a compiler run, name is the variant for the log
+bool finishTape(const char* name, const TapeCompiler& compiler, SdfTape& tape, const std::vector<uint16_t>& results) {
+  if (compiler.failed) {
+    std::cerr << "[Node editor] CPU " << name << " tape: the graph uses code nodes, which only exist in GLSL\n";
+    tape.clear();
+    return false;
+  }
+  if (!tape.finalize(results)) {
+    std::cerr << "[Node editor] CPU " << name << " tape: graph exceeds the register limit\n";
+    tape.clear();
+    return false;
+  }
+
+  std::cout << "[Node editor] Compiled CPU " << name << " tape: " << tape.getInstructionCount() << " instructions, " << tape.getRegisterCount() << " registers\n";
+  return true;
+}
+
+} // namespace
+
+bool compileSdfTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape) {
+  tape.clear();
+  TapeCompiler compiler(tape);
+
+  const auto& surface = nodes[0]->inputs[0].pins;
+  uint16_t result = surface.empty() ? tape.constant(1e10f) : compiler.compile(surface[0]).x;
+  return finishTape("SDF", compiler, tape, {result});
+}
+
+bool compileSdfTape(const Pin* pin, SdfTape& tape) {
+  tape.clear();
+  TapeCompiler compiler(tape);
+  return finishTape("subgraph", compiler, tape, {compiler.compile(pin).x});
+}
+
+bool compileSurfaceTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape) {
+  tape.clear();
+  TapeCompiler compiler(tape);
+
+  const auto& pins = nodes[0]->inputs[0].pins;
+  uint16_t zero = tape.constant(0.0f);
+  TapeSurface s = pins.empty() ? TapeSurface{tape.constant(1e10f), zero, zero, zero, zero} : compiler.surface(pins[0]);
+  return finishTape("surface", compiler, tape, {s.dist, s.r, s.g, s.b, s.roughness});
+}
+
+bool compileSkyTape(const std::vector<std::unique_ptr<Node>>& nodes, const glm::vec3& ambient, SdfTape& tape) {
+  tape.clear();
+  TapeCompiler compiler(tape);
+
+  const auto& pins = nodes[0]->inputs[1].pins;
+  TapeValue sky = pins.empty() ? compiler.vec3(ambient) : compiler.compile(pins[0]);
+  return finishTape("sky", compiler, tape, {sky.x, sky.y, sky.z});
+}
+
+bool compileLightsTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape, std::vector<TapeLight>& lights) {
+  tape.clear();
+  lights.clear();
+  TapeCompiler compiler(tape);
+
+  // see the generateGlsl of the light nodes
+  std::vector<uint16_t> results;
+  for (const Pin* pin : nodes[0]->inputs[2].pins) {
+    const Node* node = pin->node;
+    bool directional = node->getType() == NodeType::LightDirectional;
+    TapeValue color = compiler.op(Op::MUL, compiler.input(node, 1, compiler.data(node, 6)), compiler.input(node, 0, compiler.dataVec3(node, 0)));
+    uint16_t radius = compiler.input(node, 2, compiler.data(node, 7)).x;
+    uint16_t attenuation = directional ? tape.constant(0.0f) : compiler.input(node, 3, compiler.data(node, 9)).x;
+    TapeValue position = compiler.input(node, directional ? 3 : 4, compiler.dataVec3(node, 3));
+    results.insert(results.end(), {position.x, position.y, position.z, color.x, color.y, color.z, radius, attenuation});
+    lights.push_back({directional, static_cast<int>(node->data[8])});
+  }
+  if (!finishTape("lights", compiler, tape, results)) {
+    lights.clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+#ifndef SDF_TAPE_H
+#define SDF_TAPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "nodes.hpp"
+
+// The node graph distance (nodeEditorDist in main.fsh) as a register based tape, for
+// evaluating it on the CPU without a GPU round trip. Instructions are scalar, vec3 values
+// live in three registers. Evaluation runs the tape over batches of points: every register
+// is a row of batchSize lanes, so each instruction is one SIMD loop (AVX when the build
+// enables it, SSE otherwise).
+class SdfTape {
+public:
+  enum Op : uint8_t {
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MIN,
+    MAX,
+    NEG,
+    ABS,
+    SQRT,
+    SIN,
+    COS,
+    SELECT_LT, // dst = a < b ? c : d
+  };
+
+  struct Instruction {
+    Op op;
+    uint16_t dst, a, b, c, d;
+  };
+
+  static constexpr int batchSize = 64;
+  static constexpr uint16_t posRegister = 0; // x, y, z
+  static constexpr uint16_t timeRegister = 3;
+
+  // building, registers returned here are virtual until finalize()
+  void clear();
+  uint16_t constant(float value);
+  uint16_t emit(Op op, uint16_t a, uint16_t b = 0, uint16_t c = 0, uint16_t d = 0);
+  bool finalize(uint16_t result); // removes dead code and packs registers, false if the tape got too big
+  bool finalize(const std::vector<uint16_t>& results);
+
+  // distances of count points, time is uTime for graphs using the Time node
+  void evaluate(const float* x, const float* y, const float* z, float* distances, size_t count, float time = 0.0f) const;
+  float evaluate(const glm::vec3& p, float time = 0.0f) const;
+  // every output at once, outputs[i] receives count values of result i, FLOAT_MAX if the tape is invalid
+  void evaluate(const float* x, const float* y, const float* z, std::span<float* const> outputs, size_t count, float time = 0.0f) const;
+
+  bool isValid() const;
+  size_t getInstructionCount() const;
+  int getRegisterCount() const;
+  size_t getOutputCount() const;
+
+private:
+  static constexpr uint16_t fixedRegisters = 4;
+
+  std::vector<Instruction> instructions;
+  std::vector<float> constants; // registers right after the fixed ones once finalized
+  std::vector<uint16_t> results;
+  int registerCount = 0;
+  bool valid = false;
+
+  // only while building
+  std::vector<int> constantIndex; // virtual register -> constants index, -1 for computed values
+  std::unordered_map<uint32_t, uint16_t> constantRegisters; // float bits -> virtual register
+  bool overflow = false;
+
+  uint16_t newRegister(int constant);
+  bool isConstant(uint16_t reg, float& value) const;
+};
+
+// Compiles the distance of the Output node's surface. Fails for graphs with code nodes,
+// whose GLSL has no CPU equivalent. Parameters are copied into the tape, so it has to be
+// recompiled after edits. Bounding sphere culling is left out, the result is the exact
+// distance the culled shader approximates far from surfaces.
+bool compileSdfTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape);
+
+// Distance of a single surface output, the subgraph above pin.
+bool compileSdfTape(const Pin* pin, SdfTape& tape);
+
+// Material at the surface, like nodeEditorSdf. Outputs distance, color r, g, b and roughness.
+bool compileSurfaceTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape);
+
+// renderSky with the position as the sample point, outputs r, g, b. ambient is used when the sky
+// input is not linked.
+bool compileSkyTape(const std::vector<std::unique_ptr<Node>>& nodes, const glm::vec3& ambient, SdfTape& tape);
+
+struct TapeLight {
+  bool directional;
+  int shadowSteps;
+};
+
+// The Light array of rayMarch, evaluated at the march position. Eight outputs per light:
+// position (direction) x, y, z, color r, g, b (times intensity), radius and attenuation.
+bool compileLightsTape(const std::vector<std::unique_ptr<Node>>& nodes, SdfTape& tape, std::vector<TapeLight>& lights);
+
+#endif
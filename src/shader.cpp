@@ -1,22 +1,250 @@
 #include "shader.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// program binaries are stored under this directory, named by a hash of their sources and the driver
+const std::filesystem::path binaryCacheDir = "shader_cache";
+
+uint64_t fnv1a(const std::string& str, uint64_t hash = 14695981039346656037ULL) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// removes the least recently used binaries until the cache fits maxBytes, keep is never removed.
+// Loading a binary touches it, so its modification time tells when it was last used.
+void evictBinaryCache(const std::filesystem::path& keep, uintmax_t maxBytes) {
+  struct Entry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type used;
+    uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  uintmax_t total = 0;
+  std::error_code ec;
+  for (const auto& file : std::filesystem::directory_iterator(binaryCacheDir, ec)) {
+    if (!file.is_regular_file(ec) || file.path().extension() != ".bin")
+      continue;
+    Entry entry{file.path(), file.last_write_time(ec), file.file_size(ec)};
+    if (ec)
+      continue;
+    total += entry.size;
+    entries.push_back(std::move(entry));
+  }
+  if (total <= maxBytes)
+    return;
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+  for (const auto& entry : entries) {
+    if (total <= maxBytes)
+      break;
+    if (std::filesystem::equivalent(entry.path, keep, ec) || !std::filesystem::remove(entry.path, ec))
+      continue;
+    total -= entry.size;
+    std::cout << "[Shader] Evicted " << entry.path.string() << " from the binary cache (" << entry.size / 1024 << " KiB)\n";
+  }
+}
+
+// returns the info log, empty when the shader compiled
+std::string getCompileError(GLuint shader) {
+  int success;
+  char infoLog[1024];
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (success != 0)
+    return "";
+  glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+  return infoLog;
+}
+
+std::string compileShader(GLuint shader, const std::string& code) {
+  const char* source = code.c_str();
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  return getCompileError(shader);
+}
+
+bool hasParallelShaderCompile() {
+  static int supported = -1;
+  if (supported >= 0)
+    return supported == 1;
+
+  supported = 0;
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+    if (std::strcmp(ext, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(ext, "GL_ARB_parallel_shader_compile") == 0)
+      supported = 1;
+  }
+
+  // let the driver use as many threads as it likes
+  if (supported == 1 && glfwGetCurrentContext() != nullptr) {
+    typedef void(APIENTRYP MaxThreadsProc)(GLuint);
+    for (const char* procName : {"glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"}) {
+      auto maxThreads = reinterpret_cast<MaxThreadsProc>(glfwGetProcAddress(procName));
+      if (maxThreads != nullptr) {
+        maxThreads(0xFFFFFFFF);
+        break;
+      }
+    }
+  }
+
+  std::cout << "[Shader] Parallel shader compile " << (supported == 1 ? "available" : "not available") << "\n";
+  return supported == 1;
+}
+
+struct CompileJob {
+  GLuint program = 0;
+  std::string vsh;
+  std::string fsh;
+  std::string fragError;
+  std::atomic<bool> done = false;
+};
+
+// Builds programs on a hidden window whose context shares objects with the main
+// one, for drivers without parallel shader compile.
+class CompileWorker {
+public:
+  // nullptr when no shared context can be created
+  static CompileWorker* get() {
+    if (instance != nullptr || failed)
+      return instance.get();
+
+    GLFWwindow* current = glfwGetCurrentContext();
+    if (current == nullptr) {
+      failed = true;
+      return nullptr;
+    }
+
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* context = glfwCreateWindow(1, 1, "", nullptr, current);
+    glfwDefaultWindowHints();
+
+    if (context == nullptr) {
+      std::cerr << "[Shader] Could not create compile context, compiling on the main thread\n";
+      failed = true;
+      return nullptr;
+    }
+    instance.reset(new CompileWorker(context));
+    return instance.get();
+  }
+
+  // waits for the program being built, queued ones are dropped. Needs the main thread and GLFW,
+  // later compiles stay on the main thread
+  static void shutdown() {
+    instance.reset();
+    failed = true;
+  }
+
+  ~CompileWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    condition.notify_one();
+    thread.join();
+    glfwDestroyWindow(context);
+  }
+
+  void submit(std::shared_ptr<CompileJob> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    condition.notify_one();
+  }
+
+private:
+  static inline std::unique_ptr<CompileWorker> instance;
+  static inline bool failed = false;
+
+  GLFWwindow* context;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<std::shared_ptr<CompileJob>> jobs;
+  bool stop = false;
+
+  CompileWorker(GLFWwindow* context) : context(context) { thread = std::thread(&CompileWorker::run, this); }
+
+  void run() {
+    while (true) {
+      std::shared_ptr<CompileJob> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return stop || !jobs.empty(); });
+        if (stop)
+          return;
+        job = jobs.front();
+        jobs.pop_front();
+      }
+
+      // only hold the context while working, so it is never current at shutdown
+      glfwMakeContextCurrent(context);
+
+      GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+      GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+      compileShader(vertex, job->vsh);
+      job->fragError = compileShader(fragment, job->fsh);
+
+      glAttachShader(job->program, vertex);
+      glAttachShader(job->program, fragment);
+      glLinkProgram(job->program);
+      glDeleteShader(vertex);
+      glDeleteShader(fragment);
+
+      // the program has to be complete before the main context sees it
+      glFinish();
+      glfwMakeContextCurrent(nullptr);
+
+      job->done = true;
+    }
+  }
+};
+
+bool Shader::binaryCache = true;
+uintmax_t Shader::binaryCacheMaxBytes = uintmax_t(256) << 20;
 
 Shader::Shader(const std::string& name) : name(name) {
   vertexShader = glCreateShader(GL_VERTEX_SHADER);
   reloadVshSource();
-  loadShader(GL_VERTEX_SHADER, vsh.c_str());
+  std::string vertexError = compileShader(vertexShader, vsh);
+  if (!vertexError.empty())
+    std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << vertexError << std::endl;
 
-  fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
   reloadFshSource();
-  loadShader(GL_FRAGMENT_SHADER, fshEdited.c_str());
 
-  ID = glCreateProgram();
-  attachLinkShaders();
+  ID = 0;
+  buildProgram(false);
 }
 
+void Shader::shutdownCompiler() { CompileWorker::shutdown(); }
+
 void Shader::use() const { glUseProgram(ID); }
 
 void Shader::reloadVshSource() { vsh = readFile("shaders/" + name + ".vsh"); }
@@ -30,18 +258,88 @@ void Shader::resetFshSource() { fshEdited = fsh; }
 
 void Shader::reloadFragment() {
   std::cout << "[Shader] " << name << ": Reloading fragment shader\n";
-  loadShader(GL_FRAGMENT_SHADER, fshEdited.c_str());
-  attachLinkShaders();
+  buildProgram(true);
+}
+
+bool Shader::update() {
+  std::erase_if(abandonedJobs, [](const auto& job) {
+    if (!job->done)
+      return false;
+    glDeleteProgram(job->program);
+    return true;
+  });
+
+  if (pendingProgram == 0)
+    return false;
+
+  unsigned int previous = ID;
+  if (pendingJob != nullptr) {
+    if (pendingJob->done)
+      finishPending(pendingJob->fragError);
+    return ID != previous;
+  }
+
+  GLint done = 0;
+  glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &done);
+  if (done != 0)
+    finishPending(getCompileError(pendingFragment));
+  return ID != previous;
 }
 
-void Shader::setUniformInt(const std::string& name, int value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), value); }
-void Shader::setUniformFloat(const std::string& name, float value) const { glUniform1f(glGetUniformLocation(ID, name.c_str()), value); }
-void Shader::setUniformFloat(const std::string& name, float* values, int size) const { glUniform1fv(glGetUniformLocation(ID, name.c_str()), size, values); }
-void Shader::setUniformVec2(const std::string& name, const glm::vec2& value) const { glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
-void Shader::setUniformVec3(const std::string& name, const glm::vec3& value) const { glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
-void Shader::setUniformVec4(const std::string& name, const glm::vec4& value) const { glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
-void Shader::setUniformMat3(const std::string& name, const glm::mat3& value) const { glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]); }
-void Shader::setUniformMat4(const std::string& name, const glm::mat4& value) const { glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]); }
+bool Shader::isCompiling() const { return pendingProgram != 0; }
+
+void Shader::setUniform(Uniform<int> uniform, int value) const { glUniform1i(handleLocations[uniform.index], value); }
+void Shader::setUniform(Uniform<float> uniform, float value) const { glUniform1f(handleLocations[uniform.index], value); }
+void Shader::setUniform(Uniform<glm::vec2> uniform, const glm::vec2& value) const { glUniform2fv(handleLocations[uniform.index], 1, &value[0]); }
+void Shader::setUniform(Uniform<glm::vec3> uniform, const glm::vec3& value) const { glUniform3fv(handleLocations[uniform.index], 1, &value[0]); }
+void Shader::setUniform(Uniform<glm::vec4> uniform, const glm::vec4& value) const { glUniform4fv(handleLocations[uniform.index], 1, &value[0]); }
+void Shader::setUniform(Uniform<glm::mat3> uniform, const glm::mat3& value) const { glUniformMatrix3fv(handleLocations[uniform.index], 1, GL_FALSE, &value[0][0]); }
+void Shader::setUniform(Uniform<glm::mat4> uniform, const glm::mat4& value) const { glUniformMatrix4fv(handleLocations[uniform.index], 1, GL_FALSE, &value[0][0]); }
+
+int Shader::registerUniform(const std::string& uniformName) {
+  for (size_t i = 0; i < handleNames.size(); i++) {
+    if (handleNames[i] == uniformName)
+      return static_cast<int>(i);
+  }
+
+  auto it = uniformTable.find(uniformName);
+  handleNames.push_back(uniformName);
+  handleLocations.push_back(it != uniformTable.end() ? it->second : -1);
+  return static_cast<int>(handleNames.size() - 1);
+}
+
+void Shader::reflectUniforms() {
+  uniformTable.clear();
+
+  GLint count = 0;
+  GLint maxLength = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+  std::vector<char> buffer(std::max(maxLength, 1));
+  for (GLint i = 0; i < count; i++) {
+    GLint size;
+    GLenum type;
+    GLsizei length = 0;
+    glGetActiveUniform(ID, i, maxLength, &length, &size, &type, buffer.data());
+
+    std::string uniformName(buffer.data(), length);
+    GLint location = glGetUniformLocation(ID, uniformName.c_str());
+    if (location < 0) // member of a uniform block
+      continue;
+
+    // arrays are reported as name[0], accept the plain name too
+    if (uniformName.ends_with("[0]"))
+      uniformTable[uniformName.substr(0, uniformName.size() - 3)] = location;
+    uniformTable[uniformName] = location;
+  }
+
+  // optimized out uniforms get -1, which glUniform* ignores
+  for (size_t i = 0; i < handleNames.size(); i++) {
+    auto it = uniformTable.find(handleNames[i]);
+    handleLocations[i] = it != uniformTable.end() ? it->second : -1;
+  }
+}
 
 std::string Shader::readFile(const std::string& filePath) {
   std::ifstream file(filePath);
@@ -56,41 +354,188 @@ std::string Shader::readFile(const std::string& filePath) {
   return buffer.str();
 }
 
-void Shader::loadShader(GLenum type, const char* code) {
-  bool isVertex = type == GL_VERTEX_SHADER;
-  unsigned int& shader = (isVertex) ? vertexShader : fragmentShader;
-  glShaderSource(shader, 1, &code, nullptr);
-  glCompileShader(shader);
+void Shader::buildProgram(bool background) {
+  // a newer edit supersedes whatever is still compiling
+  discardPending();
+
+  pendingStart = std::chrono::steady_clock::now();
+  pendingCachePath = getBinaryCachePath();
+  pendingProgram = glCreateProgram();
+  glProgramParameteri(pendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+  if (loadBinaryCache(pendingProgram, pendingCachePath)) {
+    finishPending("");
+    return;
+  }
+
+  // compile and link return immediately, completion is polled in update()
+  if (background && hasParallelShaderCompile()) {
+    pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+    const char* code = fshEdited.c_str();
+    glShaderSource(pendingFragment, 1, &code, nullptr);
+    glCompileShader(pendingFragment);
+    attachLinkShaders(pendingProgram, pendingFragment);
+    return;
+  }
+
+  CompileWorker* worker = background ? CompileWorker::get() : nullptr;
+  if (worker != nullptr) {
+    pendingJob = std::make_shared<CompileJob>();
+    pendingJob->program = pendingProgram;
+    pendingJob->vsh = vsh;
+    pendingJob->fsh = fshEdited;
+    worker->submit(pendingJob);
+    return;
+  }
+
+  pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+  std::string error = compileShader(pendingFragment, fshEdited);
+  attachLinkShaders(pendingProgram, pendingFragment);
+  finishPending(error);
+}
+
+void Shader::attachLinkShaders(GLuint program, GLuint fragment) const {
+  glAttachShader(program, vertexShader);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+}
+
+void Shader::finishPending(const std::string& compileError) {
+  if (!compileError.empty()) {
+    std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << compileError << std::endl;
+    fragError = compileError;
+  }
 
   int success;
   char infoLog[1024];
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  glGetProgramiv(pendingProgram, GL_LINK_STATUS, &success);
   if (success == 0) {
-    glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-    std::cerr << "ERROR::SHADER::" << (isVertex ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
-    if (!isVertex)
-      fragError = infoLog;
+    if (compileError.empty()) {
+      glGetProgramInfoLog(pendingProgram, 1024, NULL, infoLog);
+      std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    // keep rendering with the last working program
+    glDeleteProgram(pendingProgram);
   } else {
-    if (!isVertex)
-      fragError = "";
+    fragError = "";
+    if (ID != 0)
+      glDeleteProgram(ID);
+    ID = pendingProgram;
+    reflectUniforms();
+    saveBinaryCache(ID, pendingCachePath);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - pendingStart;
+    std::cout << "[Shader] " << name << ": Swapped in new program after " << elapsed.count() << " ms\n";
   }
+
+  if (pendingFragment != 0)
+    glDeleteShader(pendingFragment);
+  pendingProgram = 0;
+  pendingFragment = 0;
+  pendingJob.reset();
 }
 
-void Shader::attachLinkShaders() {
-  glAttachShader(ID, vertexShader);
-  glAttachShader(ID, fragmentShader);
-  glLinkProgram(ID);
+void Shader::discardPending() {
+  if (pendingProgram == 0)
+    return;
+
+  // the worker may still be using the program, delete it once it is done
+  if (pendingJob != nullptr)
+    abandonedJobs.push_back(pendingJob);
+  else
+    glDeleteProgram(pendingProgram);
+
+  if (pendingFragment != 0)
+    glDeleteShader(pendingFragment);
+  pendingProgram = 0;
+  pendingFragment = 0;
+  pendingJob.reset();
+}
+
+const std::string& Shader::getFragError() const { return fragError; }
+
+std::string Shader::getBinaryCachePath() const {
+  if (!binaryCache)
+    return "";
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats == 0)
+    return "";
+
+  // a driver update invalidates every binary it produced
+  std::string driver;
+  for (GLenum e : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    driver += reinterpret_cast<const char*>(glGetString(e));
+
+  uint64_t hash = fnv1a(driver);
+  hash = fnv1a(vsh, hash);
+  hash = fnv1a(fshEdited, hash);
+  return (binaryCacheDir / std::format("{}_{:016x}.bin", name, hash)).string();
+}
+
+bool Shader::loadBinaryCache(GLuint program, const std::string& path) {
+  if (path.empty())
+    return false;
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  auto start = std::chrono::steady_clock::now();
+
+  GLenum format = 0;
+  file.read(reinterpret_cast<char*>(&format), sizeof(format));
+  std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+
+  glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
 
   int success;
-  char infoLog[1024];
-  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
   if (success == 0) {
-    glGetProgramInfoLog(ID, 1024, NULL, infoLog);
-    std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    std::cerr << "[Shader] " << name << ": Rejected cached binary " << path << ", compiling from source\n";
+    std::filesystem::remove(path);
+    return false;
   }
 
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  // marks the binary as recently used for evictBinaryCache
+  std::error_code ec;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "[Shader] " << name << ": Loaded cached binary in " << elapsed.count() << " ms\n";
+  return true;
 }
 
-const std::string& Shader::getFragError() const { return fragError; }
+void Shader::saveBinaryCache(GLuint program, const std::string& path) const {
+  if (path.empty() || std::filesystem::exists(path))
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  GLenum format = 0;
+  std::vector<char> binary(length);
+  glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+  std::error_code ec;
+  std::filesystem::create_directories(binaryCacheDir, ec);
+
+  // write then rename, so a crash never leaves a truncated binary behind
+  std::string tmpPath = path + ".tmp";
+  std::ofstream file(tmpPath, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[Shader] " << name << ": Could not write binary cache " << tmpPath << "\n";
+    return;
+  }
+  file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+  file.write(binary.data(), length);
+  file.close();
+  std::filesystem::rename(tmpPath, path, ec);
+
+  // every edit of the node graph is a new variant, keep the directory bounded
+  if (!ec)
+    evictBinaryCache(path, binaryCacheMaxBytes);
+}
@@ -1,57 +1,97 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/glad.h>
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+struct CompileJob;
+
+// Handle to a uniform, resolved once by name. The location behind it is
+// refreshed whenever the program is relinked.
+template <typename T> struct Uniform {
+  int index = -1;
+};
+
+// Fragment shader reloads compile in the background (driver threads through
+// GL_KHR_parallel_shader_compile, or a worker with a shared context). ID keeps
+// the last working program until update() swaps in the new one.
 class Shader {
 public:
   unsigned int ID;
   std::string fshEdited;
 
+  static bool binaryCache;              // load and store linked programs in shader_cache/
+  static uintmax_t binaryCacheMaxBytes; // least recently used binaries are evicted beyond this
+
+  // stops the background compile context, before glfwTerminate
+  static void shutdownCompiler();
+
   Shader(const std::string& name);
 
   void use() const;
 
   void reloadFragment();
+  bool update(); // call once per frame before use(), true when a new program was swapped in
+  bool isCompiling() const;
 
   void reloadFshSource();
   void reloadVshSource();
 
   void resetFshSource();
 
-  void setUniformInt(const std::string& name, int value) const;
-
-  void setUniformFloat(const std::string& name, float value) const;
-  void setUniformFloat(const std::string& name, float* values, int size) const;
-
-  void setUniformVec2(const std::string& name, const glm::vec2& value) const;
-  void setUniformVec3(const std::string& name, const glm::vec3& value) const;
-  void setUniformVec4(const std::string& name, const glm::vec4& value) const;
-
-  void setUniformMat3(const std::string& name, const glm::mat3& value) const;
-  void setUniformMat4(const std::string& name, const glm::mat4& value) const;
+  template <typename T> Uniform<T> getUniform(const std::string& uniformName) { return {registerUniform(uniformName)}; }
 
+  void setUniform(Uniform<int> uniform, int value) const;
+  void setUniform(Uniform<float> uniform, float value) const;
+  void setUniform(Uniform<glm::vec2> uniform, const glm::vec2& value) const;
+  void setUniform(Uniform<glm::vec3> uniform, const glm::vec3& value) const;
+  void setUniform(Uniform<glm::vec4> uniform, const glm::vec4& value) const;
+  void setUniform(Uniform<glm::mat3> uniform, const glm::mat3& value) const;
+  void setUniform(Uniform<glm::mat4> uniform, const glm::mat4& value) const;
 
   const std::string& getFragError() const;
 
 private:
   std::string name;
-  unsigned int fragmentShader;
   unsigned int vertexShader;
   std::string fsh;
   std::string vsh;
   std::string fragError;
 
+  // program being built, swapped into ID once linked
+  GLuint pendingProgram = 0;
+  GLuint pendingFragment = 0; // only while the driver compiles it in parallel
+  std::string pendingCachePath;
+  std::shared_ptr<CompileJob> pendingJob; // only while the worker builds it
+  std::vector<std::shared_ptr<CompileJob>> abandonedJobs;
+  std::chrono::steady_clock::time_point pendingStart;
+
+  std::unordered_map<std::string, GLint> uniformTable; // active uniforms of ID
+  std::vector<std::string> handleNames;                 // Uniform::index -> name
+  std::vector<GLint> handleLocations;                   // Uniform::index -> location in ID
+
   std::string readFile(const std::string& filePath);
 
-  void loadShader(GLenum type, const char* code);
+  std::string getBinaryCachePath() const;
+  bool loadBinaryCache(GLuint program, const std::string& path);
+  void saveBinaryCache(GLuint program, const std::string& path) const;
+
+  void buildProgram(bool background);
+  void attachLinkShaders(GLuint program, GLuint fragment) const;
+  void finishPending(const std::string& compileError);
+  void discardPending();
 
-  void attachLinkShaders();
+  int registerUniform(const std::string& uniformName);
+  void reflectUniforms();
 };
 
 #endif
@@ -0,0 +1,221 @@
+#include "tiled_render.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// PNG written a row at a time. stb_image_write only compresses whole images, so the rows go into
+// stored (uncompressed) deflate blocks and the file is about as large as the raw pixels.
+class PngStream {
+public:
+  ~PngStream() {
+    if (file != nullptr)
+      std::fclose(file);
+  }
+
+  bool open(const std::string& filePath, int w, int h) {
+    file = std::fopen(filePath.c_str(), "wb");
+    if (file == nullptr)
+      return false;
+    width = w;
+    rowsLeft = h;
+
+    static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::fwrite(signature, 1, sizeof(signature), file);
+
+    // 8 bit RGB, no interlacing
+    unsigned char header[13] = {};
+    putBigEndian(header, static_cast<uint32_t>(w));
+    putBigEndian(header + 4, static_cast<uint32_t>(h));
+    header[8] = 8;
+    header[9] = 2;
+    writeChunk("IHDR", header, sizeof(header));
+    return true;
+  }
+
+  // RGB, top row first
+  void writeRow(const unsigned char* pixels) {
+    size_t rowBytes = 1 + static_cast<size_t>(width) * 3; // filter byte, none
+    size_t blockCount = (rowBytes + maxBlock - 1) / maxBlock;
+    bool last = --rowsLeft == 0;
+
+    chunkData.clear();
+    if (!started) {
+      chunkData.push_back(0x78); // zlib header, 32K window, no preset dictionary
+      chunkData.push_back(0x01);
+      started = true;
+    }
+    size_t offset = 0;
+    for (size_t block = 0; block < blockCount; block++) {
+      auto length = static_cast<uint16_t>(std::min(maxBlock, rowBytes - offset));
+      auto inverse = static_cast<uint16_t>(~length);
+      unsigned char blockHeader[] = {static_cast<unsigned char>(last && block + 1 == blockCount ? 1 : 0), // BFINAL, BTYPE 00
+                                     static_cast<unsigned char>(length & 0xff), static_cast<unsigned char>(length >> 8),
+                                     static_cast<unsigned char>(inverse & 0xff), static_cast<unsigned char>(inverse >> 8)};
+      chunkData.insert(chunkData.end(), blockHeader, blockHeader + sizeof(blockHeader));
+      // offsets count the filter byte in front of the pixels
+      size_t begin = offset;
+      if (begin == 0) {
+        chunkData.push_back(0);
+        begin = 1;
+      }
+      chunkData.insert(chunkData.end(), pixels + begin - 1, pixels + offset + length - 1);
+      offset += length;
+    }
+    adler(0);
+    for (size_t i = 0; i + 1 < rowBytes; i += nmax)
+      adler(pixels + i, std::min(nmax, rowBytes - 1 - i));
+
+    if (last) {
+      unsigned char checksum[4];
+      putBigEndian(checksum, (adlerB << 16) | adlerA);
+      chunkData.insert(chunkData.end(), checksum, checksum + 4);
+    }
+    writeChunk("IDAT", chunkData.data(), chunkData.size());
+  }
+
+  bool close() {
+    writeChunk("IEND", nullptr, 0);
+    bool ok = std::ferror(file) == 0;
+    ok &= std::fclose(file) == 0;
+    file = nullptr;
+    return ok && rowsLeft == 0;
+  }
+
+private:
+  static constexpr size_t maxBlock = 65535; // bytes of a stored block
+  static constexpr size_t nmax = 5552;      // bytes summed before adlerB could overflow
+
+  FILE* file = nullptr;
+  int width = 0, rowsLeft = 0;
+  bool started = false; // zlib header written
+  uint32_t adlerA = 1, adlerB = 0;
+  std::vector<unsigned char> chunkData; // one row in stored blocks
+
+  static void putBigEndian(unsigned char* out, uint32_t value) {
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+  }
+
+  static uint32_t crc(uint32_t c, const unsigned char* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+      std::array<uint32_t, 256> t;
+      for (uint32_t n = 0; n < 256; n++) {
+        uint32_t v = n;
+        for (int k = 0; k < 8; k++)
+          v = (v & 1) != 0 ? 0xedb88320u ^ (v >> 1) : v >> 1;
+        t[n] = v;
+      }
+      return t;
+    }();
+    for (size_t i = 0; i < size; i++)
+      c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    return c;
+  }
+
+  void adler(unsigned char byte) { adler(&byte, 1); }
+
+  void adler(const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      adlerA += data[i];
+      adlerB += adlerA;
+    }
+    adlerA %= 65521;
+    adlerB %= 65521;
+  }
+
+  void writeChunk(const char* type, const unsigned char* data, size_t size) {
+    unsigned char length[4];
+    putBigEndian(length, static_cast<uint32_t>(size));
+    std::fwrite(length, 1, 4, file);
+    std::fwrite(type, 1, 4, file);
+    if (size > 0)
+      std::fwrite(data, 1, size, file);
+
+    uint32_t c = crc(0xffffffffu, reinterpret_cast<const unsigned char*>(type), 4);
+    c = crc(c, data, size) ^ 0xffffffffu;
+    unsigned char checksum[4];
+    putBigEndian(checksum, c);
+    std::fwrite(checksum, 1, 4, file);
+  }
+};
+
+} // namespace
+
+bool TiledRenderer::render(Viewport& viewport, std::string& filePath, float time) {
+  if (viewport.shader.isCompiling() || !viewport.shader.getFragError().empty()) {
+    std::cerr << "[Tiled render] The shader isn't ready\n";
+    return false;
+  }
+  if (!filePath.ends_with(".png"))
+    filePath += ".png";
+
+  auto start = std::chrono::steady_clock::now();
+  width = std::max(width, 1);
+  height = std::max(height, 1);
+  samples = std::max(samples, 1);
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  tileSize = std::clamp(tileSize, 16, std::max(static_cast<int>(maxSize), 16));
+
+  PngStream png;
+  if (!png.open(filePath, width, height)) {
+    std::cerr << "[Tiled render] Can't write " << filePath << "\n";
+    return false;
+  }
+
+  Framebuffer tile(GL_RGBA32F, GL_RGBA, GL_FLOAT);
+  tile.resize(tileSize, tileSize);
+
+  std::vector<unsigned char> band(static_cast<size_t>(width) * tileSize * 3);
+  std::vector<unsigned char> tilePixels(static_cast<size_t>(tileSize) * tileSize * 3);
+  peakBytes = band.size() + tilePixels.size() + static_cast<size_t>(tileSize) * tileSize * 4 * sizeof(float);
+
+  // bands from the top of the image, GL rows count from the bottom
+  int bandCount = (height + tileSize - 1) / tileSize;
+  for (int b = 0; b < bandCount; b++) {
+    int y1 = height - b * tileSize;
+    int y0 = std::max(y1 - tileSize, 0);
+    int bandHeight = y1 - y0;
+
+    for (int x0 = 0; x0 < width; x0 += tileSize) {
+      int tileWidth = std::min(tileSize, width - x0);
+      for (int sample = 1; sample <= samples; sample++)
+        viewport.renderTile(tile, glm::ivec4(x0, y0, tileWidth, bandHeight), glm::ivec2(width, height), sample, time);
+
+      // the float mean is clamped and quantized by the read
+      tile.bind();
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, tileWidth, bandHeight, GL_RGB, GL_UNSIGNED_BYTE, tilePixels.data());
+      tile.unbind();
+      for (int y = 0; y < bandHeight; y++) {
+        const unsigned char* source = tilePixels.data() + static_cast<size_t>(bandHeight - 1 - y) * tileWidth * 3;
+        std::memcpy(band.data() + (static_cast<size_t>(y) * width + x0) * 3, source, static_cast<size_t>(tileWidth) * 3);
+      }
+    }
+
+    for (int y = 0; y < bandHeight; y++)
+      png.writeRow(band.data() + static_cast<size_t>(y) * width * 3);
+    std::cout << "[Tiled render] Band " << b + 1 << " / " << bandCount << " done\n";
+  }
+
+  glDeleteFramebuffers(1, &tile.ID);
+  glDeleteTextures(1, &tile.textureID);
+
+  bool saved = png.close();
+  renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (saved)
+    std::cout << "[Tiled render] Saved " << width << "x" << height << " render to " << filePath << " in " << renderMs << " ms\n";
+  else
+    std::cerr << "[Tiled render] Failed to write " << filePath << "\n";
+  return saved;
+}
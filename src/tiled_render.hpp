@@ -0,0 +1,25 @@
+#ifndef TILED_RENDER_H
+#define TILED_RENDER_H
+
+#include <string>
+
+#include "viewport.hpp"
+
+// Renders images beyond the viewport size and the framebuffer limits on the GPU. The image is
+// split into tiles drawn by Viewport::renderTile, each accumulating samples jittered over the
+// pixels of the whole image. Tiles are rendered a band at a time from the top and every band is
+// streamed into the PNG, so the GPU holds one tile and the CPU one band of rows.
+class TiledRenderer {
+public:
+  int width = 16384, height = 16384;
+  int tileSize = 1024;
+  int samples = 16; // per pixel
+
+  double renderMs = 0.0;
+  size_t peakBytes = 0; // tile framebuffer and band buffer
+
+  // blocks until the file is written, false if the shader isn't ready or the file can't be written
+  bool render(Viewport& viewport, std::string& filePath, float time);
+};
+
+#endif
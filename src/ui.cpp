@@ -1,5 +1,6 @@
 #include "ui.hpp"
 
+#include <algorithm>
 #include <cfloat>
 #include <format>
 #include <iostream>
@@ -8,11 +9,15 @@
 #include <imfilebrowser.h>
 #include <imgui.h>
 
+#include "animation_export.hpp"
+#include "cpu_renderer.hpp"
 #include "imgui_node_editor.h"
+#include "mesh_export.hpp"
 #include "node_graph.hpp"
 #include "nodes.hpp"
 #include "projectdata.hpp"
 #include "scene.hpp"
+#include "tiled_render.hpp"
 #include "viewport.hpp"
 
 void setupImGuiStyle() {
@@ -127,33 +132,6 @@ void updateWindowTitle(GLFWwindow* window, std::string& filepath) {
   glfwSetWindowTitle(window, title.c_str());
 };
 
-void reloadNodeScene(NodeEditor& nodeEditor, Shader& shader) {
-  std::string surfaceCode;
-  std::string skyCode;
-  std::string lightsCode;
-  nodeEditor.generateGlslCode(surfaceCode, skyCode, lightsCode);
-
-  shader.resetFshSource();
-  std::string& code = shader.fshEdited;
-
-  auto line = code.find("// !sky_inline");
-  code.insert(line, skyCode);
-  line = code.find("// !sdf_inline", line);
-  code.insert(line, surfaceCode);
-  line = code.find("// !lights_inline", line);
-  code.insert(line, lightsCode);
-
-  std::cout << "[Node editor] Inline shader code: Surface\n" << surfaceCode << "\n";
-  std::cout << "[Node editor] Inline shader code: Sky\n" << skyCode << "\n";
-  std::cout << "[Node editor] Inline shader code: Lights\n" << lightsCode << "\n";
-  std::cout << "[Node editor] uN[] data: ";
-  for (const auto* val : dataPointers)
-    std::cout << *val << ", ";
-  std::cout << "\n\n";
-
-  shader.reloadFragment();
-}
-
 void setupUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& scene, NodeEditor& nodeEditor) {
   setStyle();
   std::string a;
@@ -162,6 +140,9 @@ void setupUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
   nodeEditor.setStructureOnChangeCallback([&] { reloadNodeScene(nodeEditor, viewport.shader); });
 }
 
+// outlives buildUi for shutdownUi
+static AnimationExporter animationExporter;
+
 void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& scene, NodeEditor& nodeEditor) {
   ImGui_ImplOpenGL3_NewFrame();
   ImGui_ImplGlfw_NewFrame();
@@ -172,12 +153,34 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
   static auto loadFileDialog = ImGui::FileBrowser();
   static auto saveFileDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
   static auto saveImageDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
+  static auto saveTimingsDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
+  static auto saveMeshDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
+  static auto saveAnimationDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
+  static auto saveTiledDialog = ImGui::FileBrowser(ImGuiFileBrowserFlags_EnterNewFilename);
+  static bool cpuCapture = false; // saveImageDialog renders the image on the CPU
+  static float meshExportSize = 10.0f;
+  static int meshExportDepth = 8;
+  static TiledRenderer tiledRenderer;
+  // finished background captures, shown for a few seconds
+  struct CaptureNotice {
+    ImageCapture::Result result;
+    double shownUntil;
+  };
+  static std::vector<CaptureNotice> captureNotices;
   loadFileDialog.SetTitle("Load project file");
   loadFileDialog.SetTypeFilters({".prj"});
   saveFileDialog.SetTitle("Save project file");
   saveFileDialog.SetTypeFilters({".prj"});
   saveImageDialog.SetTitle("Save image");
   saveImageDialog.SetTypeFilters({".png"});
+  saveMeshDialog.SetTitle("Export mesh");
+  saveMeshDialog.SetTypeFilters({".ply", ".obj"});
+  saveAnimationDialog.SetTitle("Export animation");
+  saveAnimationDialog.SetTypeFilters({".png"});
+  saveTiledDialog.SetTitle("Save tiled render");
+  saveTiledDialog.SetTypeFilters({".png"});
+  saveTimingsDialog.SetTitle("Export GPU timings");
+  saveTimingsDialog.SetTypeFilters({".csv"});
 
   static bool optFullscreenPersistant = true;
   static ImGuiDockNodeFlags dockspaceFlags = ImGuiDockNodeFlags_None;
@@ -234,8 +237,54 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
       }
       if (ImGui::BeginMenu("Project")) {
         if (ImGui::MenuItem("Save image")) {
+          cpuCapture = false;
+          saveImageDialog.Open();
+        }
+        if (ImGui::MenuItem("Save image (CPU render)")) {
+          cpuCapture = true;
           saveImageDialog.Open();
         }
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputInt("##tiledwidth", &tiledRenderer.width, 1024, 4096);
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputInt("##tiledheight", &tiledRenderer.height, 1024, 4096);
+        tiledRenderer.width = std::max(tiledRenderer.width, 1);
+        tiledRenderer.height = std::max(tiledRenderer.height, 1);
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderInt("##tiledsamples", &tiledRenderer.samples, 1, 256, "%d spp");
+        if (ImGui::MenuItem("Save tiled render")) {
+          saveTiledDialog.Open();
+        }
+        ImGui::Separator();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputFloat("##meshexportsize", &meshExportSize, 1.0f, 10.0f, "size %.1f");
+        meshExportSize = std::max(meshExportSize, 0.01f);
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderInt("##meshexportdepth", &meshExportDepth, 1, MeshExporter::maxDepth, "depth %d");
+        ImGui::SameLine();
+        if (ImGui::MenuItem("Export mesh")) {
+          saveMeshDialog.Open();
+        }
+        ImGui::Separator();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputFloat("##animationstart", &animationExporter.startTime, 0.1f, 1.0f, "from %.2f s");
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputFloat("##animationend", &animationExporter.endTime, 0.1f, 1.0f, "to %.2f s");
+        animationExporter.endTime = std::max(animationExporter.endTime, animationExporter.startTime);
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputFloat("##animationfps", &animationExporter.fps, 1.0f, 10.0f, "%.0f fps");
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderInt("##animationsamples", &animationExporter.samples, 1, 256, "%d spp");
+        if (animationExporter.isRunning()) {
+          if (ImGui::MenuItem("Cancel animation"))
+            animationExporter.cancel();
+        } else if (ImGui::MenuItem("Export animation")) {
+          saveAnimationDialog.Open();
+        }
+        ImGui::Separator();
+        if (ImGui::MenuItem("Export GPU timings")) {
+          saveTimingsDialog.Open();
+        }
         ImGui::EndMenu();
       }
       if (ImGui::BeginMenu("About")) {
@@ -249,6 +298,10 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
       loadFileDialog.Display();
       saveFileDialog.Display();
       saveImageDialog.Display();
+      saveMeshDialog.Display();
+      saveAnimationDialog.Display();
+      saveTiledDialog.Display();
+      saveTimingsDialog.Display();
 
       if (loadFileDialog.HasSelected()) {
         std::string path = loadFileDialog.GetSelected();
@@ -265,9 +318,47 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
       }
       if (saveImageDialog.HasSelected()) {
         std::string path = saveImageDialog.GetSelected();
-        viewport.captureImage(path);
+        if (cpuCapture) {
+          // blocks the UI until the last tile is done
+          CpuRenderer cpuRenderer;
+          float time = viewport.fixedTime >= 0.0f ? viewport.fixedTime : static_cast<float>(glfwGetTime());
+          if (cpuRenderer.render(viewport, viewport.width, viewport.height, time))
+            cpuRenderer.saveImage(path);
+        } else {
+          viewport.captureImage(path);
+        }
         saveImageDialog.ClearSelected();
       }
+      if (saveMeshDialog.HasSelected()) {
+        std::string path = saveMeshDialog.GetSelected();
+        // a cube around the point the camera orbits, blocks the UI like the CPU render
+        MeshExporter meshExporter;
+        meshExporter.center = -viewport.camera.target;
+        meshExporter.size = meshExportSize;
+        meshExporter.depth = meshExportDepth;
+        float time = viewport.fixedTime >= 0.0f ? viewport.fixedTime : static_cast<float>(glfwGetTime());
+        if (meshExporter.build(nodeEditor, scene, time))
+          meshExporter.save(path);
+        saveMeshDialog.ClearSelected();
+      }
+      if (saveTiledDialog.HasSelected()) {
+        std::string path = saveTiledDialog.GetSelected();
+        // blocks the UI like the CPU render, the viewport's own image is left as it was
+        float time = viewport.fixedTime >= 0.0f ? viewport.fixedTime : static_cast<float>(glfwGetTime());
+        tiledRenderer.render(viewport, path, time);
+        saveTiledDialog.ClearSelected();
+      }
+      if (saveAnimationDialog.HasSelected()) {
+        animationExporter.start(viewport, saveAnimationDialog.GetSelected());
+        saveAnimationDialog.ClearSelected();
+      }
+      if (saveTimingsDialog.HasSelected()) {
+        std::string path = saveTimingsDialog.GetSelected();
+        if (!path.ends_with(".csv"))
+          path += ".csv";
+        viewport.gpuTimer.exportCsv(path);
+        saveTimingsDialog.ClearSelected();
+      }
     }
 
     // ImGui::ShowDemoWindow();
@@ -282,6 +373,15 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
             scene.addObject(Shape::BOX);
           if (ImGui::MenuItem("Sphere"))
             scene.addObject(Shape::SPHERE);
+          ImGui::Separator();
+          static int benchmarkCount = 1000;
+          ImGui::SetNextItemWidth(100.0f);
+          ImGui::InputInt("##benchmarkcount", &benchmarkCount, 100, 1000);
+          benchmarkCount = std::max(benchmarkCount, 0);
+          ImGui::SameLine();
+          if (ImGui::MenuItem("Benchmark grid")) {
+            scene.fillBenchmark(static_cast<unsigned int>(benchmarkCount));
+          }
           ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
@@ -291,14 +391,66 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
 
       viewport.hovered = ImGui::IsWindowHovered();
 
-      viewport.resize(static_cast<int>(wsize.x), static_cast<int>(wsize.y)); // only resizes if wsize changed
+      // frames of an animation keep the size it started with
+      if (!animationExporter.isRunning())
+        viewport.resize(static_cast<int>(wsize.x), static_cast<int>(wsize.y)); // only resizes if wsize changed
+
+      // a UI frame worth of output frames, and no blocking in the main loop until all are written
+      if (animationExporter.isRunning()) {
+        animationExporter.update(viewport, 30.0);
+        glfwPostEmptyEvent();
+      }
       ImGui::Image((ImTextureID)viewport.taaFramebuffer.textureID, wsize, ImVec2(0, 1), ImVec2(1, 0));
 
-      std::string fpsText(5, '\0');
-      sprintf(fpsText.data(), "%.0f FPS", ImGui::GetIO().Framerate);
+      // status boxes in the top left corner, stacked from the top
       ImDrawList* drawList = ImGui::GetWindowDrawList();
-      drawList->AddRectFilled(ImVec2(p.x + 5.0f, p.y + 5.0f), ImVec2(p.x + 72.0f, p.y + 20.0f), ImColor(0.0f, 0.0f, 0.0f, 0.5f));
-      drawList->AddText(ImVec2(p.x + 8.0f, p.y + 5.0f), ImColor(1.0f, 1.0f, 1.0f, 1.0f), fpsText.data());
+      float overlayY = p.y + 5.0f;
+      auto drawOverlayText = [&](const std::string& text) {
+        float textWidth = ImGui::CalcTextSize(text.c_str()).x;
+        drawList->AddRectFilled(ImVec2(p.x + 5.0f, overlayY), ImVec2(p.x + 11.0f + textWidth, overlayY + 15.0f), ImColor(0.0f, 0.0f, 0.0f, 0.5f));
+        drawList->AddText(ImVec2(p.x + 8.0f, overlayY), ImColor(1.0f, 1.0f, 1.0f, 1.0f), text.c_str());
+        overlayY += 17.0f;
+      };
+
+      drawOverlayText(std::format("{:.0f} FPS", ImGui::GetIO().Framerate));
+      if (viewport.getAccumulatedSamples() > 0)
+        drawOverlayText(std::format("{} / {} spp", viewport.getAccumulatedSamples(), viewport.progressiveMaxSamples));
+      if (animationExporter.isRunning())
+        drawOverlayText(std::format("frame {} / {}, {} written, {:.1f} frames/s, encode backlog {}", animationExporter.getFramesRendered(), animationExporter.getFrameCount(), animationExporter.getFramesWritten(), animationExporter.getFramesPerSecond(), animationExporter.getBacklog()));
+
+      // per pass GPU times over the last GpuTimer::window frames
+      static bool timingsOpen = false;
+      const GpuTimer& timer = viewport.gpuTimer;
+      float rows = timingsOpen ? static_cast<float>(timer.passNames.size()) + 4.0f : 1.0f;
+      ImGui::SetCursorScreenPos(ImVec2(p.x + 5.0f, overlayY + 3.0f));
+      ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(0.0f, 0.0f, 0.0f, 0.5f));
+      ImGui::BeginChild("GPU timings", ImVec2(260.0f, rows * ImGui::GetFrameHeightWithSpacing() + 4.0f), false, ImGuiWindowFlags_NoScrollbar);
+      timingsOpen = ImGui::CollapsingHeader("GPU timings");
+      if (timingsOpen && ImGui::BeginTable("passes", 4)) {
+        ImGui::TableSetupColumn("pass");
+        ImGui::TableSetupColumn("min");
+        ImGui::TableSetupColumn("avg");
+        ImGui::TableSetupColumn("p99");
+        ImGui::TableHeadersRow();
+        for (int pass = 0; pass < static_cast<int>(timer.passNames.size()); pass++) {
+          GpuTimer::Stats stats = timer.getStats(pass);
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(timer.passNames[pass].c_str());
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", stats.min);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", stats.avg);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", stats.p99);
+        }
+        ImGui::EndTable();
+        ImGui::Text("%zu frames, %lu dropped", timer.getHistory().size(), timer.getDropped());
+        if (ImGui::Button("Export CSV"))
+          saveTimingsDialog.Open();
+      }
+      ImGui::EndChild();
+      ImGui::PopStyleColor();
     }
     ImGui::End();
 
@@ -310,12 +462,73 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
         ImGui::SliderFloat("Scale", &viewport.camera.scale, 0.05, 2.0);
       }
       if (ImGui::CollapsingHeader("Renderer", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Checkbox("Dynamic resolution", &viewport.dynamicResolution);
+        if (viewport.dynamicResolution) {
+          ImGui::SameLine();
+          ImGui::SetNextItemWidth(100.0f);
+          ImGui::DragFloat("Budget (ms)", &viewport.frameBudgetMs, 0.1f, 1.0f, 100.0f, "%.1f");
+        }
+        ImGui::BeginDisabled(viewport.dynamicResolution);
         ImGui::SliderFloat("Downscale", &viewport.downscaleFactor, 0.0, 0.95);
+        ImGui::EndDisabled();
         ImGui::SliderInt("Iterations", &viewport.raymarchSteps, 4, 128);
         ImGui::SliderFloat("Ray start", &viewport.raymarchingClipStart, 0.0, 4.0);
         ImGui::SliderFloat("Ray end", &viewport.raymarchingClipEnd, 0.5, 256.0);
         ImGui::SliderFloat("Pixel radius", &viewport.raymarchingPixelRadius, 0.0001, 0.01, "%.4f");
         ImGui::SliderFloat("TAAU Feedback", &viewport.taaFeedbackFactor, 0.0, 0.98);
+        ImGui::Checkbox("Progressive", &viewport.progressive);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::DragInt("Max samples", &viewport.progressiveMaxSamples, 16.0f, 1, 65536);
+
+        // raymarch time of each mode, sampled once the new shader has settled
+        static float liveTimeMs = 0.0f;
+        static float bakedTimeMs = 0.0f;
+        static int framesSinceSwitch = 0;
+        if (ImGui::Checkbox("Bake node parameters", &nodeEditor.bakeParameters)) {
+          reloadNodeScene(nodeEditor, viewport.shader);
+          framesSinceSwitch = 0;
+        }
+        if (++framesSinceSwitch > 60)
+          (nodeEditor.bakeParameters ? bakedTimeMs : liveTimeMs) = viewport.raymarchTimeMs;
+        ImGui::Text("Raymarch pass: %.2f ms", viewport.raymarchTimeMs);
+        if (liveTimeMs > 0.0f && bakedTimeMs > 0.0f)
+          ImGui::Text("Baked speedup: %.2fx (%.2f -> %.2f ms)", liveTimeMs / bakedTimeMs, liveTimeMs, bakedTimeMs);
+        const auto& parameters = nodeEditor.getParameters();
+        ImGui::Text("Node parameters: %lu floats (%lu uploaded)", parameters.getSize(), parameters.getLastUploadSize());
+        ImGui::Text("Objects: %zu (%lu uploaded)", scene.sceneTree.size(), scene.getLastUploadCount());
+        const auto& brickMap = nodeEditor.getBrickMap();
+        if (!brickMap.getVolumes().empty()) {
+          ImGui::Text("Baked volumes: %zu (%zu KiB)", brickMap.getVolumes().size(), brickMap.getBytes() / 1024);
+          // evaluations away from the surface still run the exact code, so per pixel is an upper bound
+          const auto& counters = viewport.sdfCounters;
+          float evalsPerPixel = static_cast<float>(counters.getTotal()) / static_cast<float>(std::max(viewport.renderWidth * viewport.renderHeight, 1));
+          for (const auto& volume : brickMap.getVolumes()) {
+            if (viewport.countSdfEvals)
+              ImGui::BulletText("Node %lu: %zu KiB, saves up to %.0f instructions per pixel", volume.nodeId, volume.getBytes() / 1024,
+                                static_cast<float>(volume.exactInstructions) * evalsPerPixel);
+            else
+              ImGui::BulletText("Node %lu: %zu KiB, saves up to %zu instructions per evaluation", volume.nodeId, volume.getBytes() / 1024, volume.exactInstructions);
+          }
+        }
+
+        const char* debugViews[] = {"Shaded", "Cost: total", "Cost: primary", "Cost: shadow + reflection", "Cost: normal"};
+        ImGui::Combo("Debug view", &viewport.debugView, debugViews, IM_ARRAYSIZE(debugViews));
+        if (viewport.debugView != DEBUG_NONE)
+          ImGui::DragFloat("Heatmap max", &viewport.heatmapMax, 1.0f, 1.0f, 4096.0f, "%.0f evals");
+        ImGui::Checkbox("Count SDF evaluations", &viewport.countSdfEvals);
+        // the counters cost even when unused, so they are only compiled in while needed
+        bool countEvals = viewport.debugView != DEBUG_NONE || viewport.countSdfEvals;
+        if (countEvals != nodeEditor.countEvals) {
+          nodeEditor.countEvals = countEvals;
+          reloadNodeScene(nodeEditor, viewport.shader);
+        }
+        if (viewport.countSdfEvals) {
+          const auto& counters = viewport.sdfCounters;
+          ImGui::Text("SDF evaluations: %lu", counters.getTotal());
+          for (int i = 0; i < SdfCounters::categories; i++)
+            ImGui::BulletText("%s: %u", SdfCounters::names[i], counters.counts[i]);
+        }
       }
       if (ImGui::CollapsingHeader("World", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::ColorEdit3("Ambient color", &viewport.ambientColor.x, ImGuiColorEditFlags_Float | ImGuiColorEditFlags_HDR);
@@ -355,25 +568,28 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
 
     ImGui::Begin("Properties", nullptr, ImGuiWindowFlags_NoScrollbar);
     {
-      if (selected < UINT_MAX && objs.size() > 0) {
+      if (selected < objs.size()) {
         Object& active = scene.sceneTree[selected];
 
         ImGui::InputText("Name", active.name.data(), 16);
 
         if (ImGui::CollapsingHeader("Transformation", ImGuiTreeNodeFlags_DefaultOpen)) {
           const float s = 0.02f;
+          bool changed = false;
           ImGui::SeparatorText("Position");
-          ImGui::DragFloat("X##position", &active.position.x, s);
-          ImGui::DragFloat("Y##position", &active.position.y, s);
-          ImGui::DragFloat("Z##position", &active.position.z, s);
+          changed |= ImGui::DragFloat("X##position", &active.position.x, s);
+          changed |= ImGui::DragFloat("Y##position", &active.position.y, s);
+          changed |= ImGui::DragFloat("Z##position", &active.position.z, s);
           ImGui::SeparatorText("Scale");
-          ImGui::DragFloat("X##scale", &active.scale.x, s);
-          ImGui::DragFloat("Y##scale", &active.scale.y, s);
-          ImGui::DragFloat("Z##scale", &active.scale.z, s);
+          changed |= ImGui::DragFloat("X##scale", &active.scale.x, s);
+          changed |= ImGui::DragFloat("Y##scale", &active.scale.y, s);
+          changed |= ImGui::DragFloat("Z##scale", &active.scale.z, s);
           ImGui::SeparatorText("Rotation");
-          ImGui::DragFloat("X##roation", &active.rotation.x, s);
-          ImGui::DragFloat("Y##roation", &active.rotation.y, s);
-          ImGui::DragFloat("Z##roation", &active.rotation.z, s);
+          changed |= ImGui::DragFloat("X##roation", &active.rotation.x, s);
+          changed |= ImGui::DragFloat("Y##roation", &active.rotation.y, s);
+          changed |= ImGui::DragFloat("Z##roation", &active.rotation.z, s);
+          if (changed)
+            scene.markDirty(selected);
         }
       }
     }
@@ -400,6 +616,9 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
         if (ImGui::MenuItem("Refresh"))
           reloadNodeScene(nodeEditor, viewport.shader);
 
+        if (viewport.shader.isCompiling())
+          ImGui::TextDisabled("Compiling...");
+
         const auto& shaderError = viewport.shader.getFragError();
         if (!shaderError.empty()) {
           ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Compilation Error!");
@@ -438,4 +657,30 @@ void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
     ImGui::End();
   }
   ImGui::End(); // Dockspace
+
+  double now = glfwGetTime();
+  for (auto& result : viewport.imageCapture.takeResults())
+    captureNotices.push_back({result, now + 4.0});
+  std::erase_if(captureNotices, [&](const CaptureNotice& notice) { return notice.shownUntil < now; });
+  if (!captureNotices.empty()) {
+    // notices expire here, so the main loop must not block on events while any are shown
+    glfwPostEmptyEvent();
+    const ImGuiViewport* imguiViewport = ImGui::GetMainViewport();
+    ImVec2 corner = imguiViewport->WorkPos + imguiViewport->WorkSize - ImVec2(10, 10);
+    ImGui::SetNextWindowPos(corner, ImGuiCond_Always, ImVec2(1.0f, 1.0f));
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+                             ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
+    if (ImGui::Begin("Capture notices", nullptr, flags)) {
+      for (const auto& notice : captureNotices) {
+        if (notice.result.saved)
+          ImGui::Text("Saved %s (%.0f ms)", notice.result.filePath.c_str(), notice.result.ms);
+        else
+          ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed to save %s", notice.result.filePath.c_str());
+      }
+    }
+    ImGui::End();
+  }
 }
+
+void shutdownUi(Viewport& viewport) { animationExporter.flush(viewport); }
@@ -17,4 +17,7 @@ void setupUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& sce
 
 void buildUi(GLFWwindow* window, ProjectData& pd, Viewport& viewport, Scene& scene, NodeEditor& nodeEditor);
 
+// writes what exports are still running, while the GL context is alive
+void shutdownUi(Viewport& viewport);
+
 #endif
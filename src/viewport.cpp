@@ -1,6 +1,8 @@
 #include "viewport.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -10,18 +12,18 @@
 #include <stb_image_write.h>
 
 #include "camera.hpp"
-#include "nodes.hpp"
+#include "node_graph.hpp"
 #include "scene.hpp"
 #include "shader.hpp"
 
-Framebuffer::Framebuffer() {
+Framebuffer::Framebuffer(GLint internalFormat, GLenum format, GLenum type) : internalFormat(internalFormat), format(format), type(type) {
   glGenFramebuffers(1, &ID);
   glBindFramebuffer(GL_FRAMEBUFFER, ID);
 
   // use size 10 - will be resized later
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_2D, textureID);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 10, 10, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, 10, 10, 0, format, type, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
@@ -37,14 +39,14 @@ Framebuffer::Framebuffer() {
 
 void Framebuffer::resize(int width, int height) {
   glBindTexture(GL_TEXTURE_2D, textureID);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
 }
 
 void Framebuffer::bind() const { glBindFramebuffer(GL_FRAMEBUFFER, ID); }
 
 void Framebuffer::unbind() const { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
 
-Viewport::Viewport(GLFWwindow* window, Scene* scene) : window(window), camera(Camera(1.0, 1.0)), shader(Shader("main")), taaShader(Shader("taa")), scene(scene) {
+Viewport::Viewport(GLFWwindow* window, Scene* scene, NodeEditor* nodeEditor) : window(window), camera(Camera(1.0, 1.0)), shader(Shader("main")), taaShader(Shader("taa")), scene(scene), nodeEditor(nodeEditor) {
   createMesh();
 
   downscaleFactorPrivate = downscaleFactor;
@@ -56,6 +58,11 @@ Viewport::Viewport(GLFWwindow* window, Scene* scene) : window(window), camera(Ca
 
   precalculateHaltonSequence();
 
+  resolveUniforms();
+
+  if (window == nullptr)
+    return;
+
   bindKeys();
 
   // https://discourse.glfw.org/t/what-is-a-possible-use-of-glfwgetwindowuserpointer/1294/2
@@ -82,72 +89,252 @@ void Viewport::resize(int w, int h) {
   framebuffer.resize(renderWidth, renderHeight);
   taaFramebuffer.resize(width, height);
   taaHistoryFramebuffer.resize(width, height);
+  accumFramebuffer.resize(width, height);
 }
 
 void Viewport::render() {
-  scene->updateObjectUbo();
+  // hands finished readbacks to the encoder, also while converged
+  imageCapture.update();
+
+  // pick up programs that finished compiling since the last frame
+  bool changed = shader.update();
+  changed |= taaShader.update();
+
+  changed |= scene->updateObjectUbo();
+  changed |= nodeEditor->updateParameters();
+  changed |= fixedTime < 0.0f && nodeEditor->usesTime();
+
+  RenderState state = getRenderState();
+  changed |= state != lastRenderState;
+  lastRenderState = state;
+
+  // a static view is refined progressively, any change drops back to the TAA preview
+  bool accumulate = progressive && !changed;
+  if (changed) {
+    staticFrames = 0;
+    accumulatedSamples = 0;
+  }
+  if (converged() && !alwaysRender)
+    return;
+  staticFrames++;
+
+  glm::ivec2 resolution(renderWidth, renderHeight);
+  if (accumulate) {
+    accumulatedSamples++;
+    resolution = glm::ivec2(width, height);
+
+    // the sequence continues past maxFrames, offsets span a whole pixel
+    float pixel = 1.0f / static_cast<float>(std::max(width, height));
+    jitterOffset.x = (halton(accumulatedSamples, 2) - 0.5f) * pixel;
+    jitterOffset.y = (halton(accumulatedSamples, 3) - 0.5f) * pixel;
+  } else {
+    jitterOffset.x = taaFeedbackFactor * haltonSequence[frameCounter % maxFrames].x / static_cast<float>(renderWidth);
+    jitterOffset.y = taaFeedbackFactor * haltonSequence[frameCounter % maxFrames].y / static_cast<float>(renderHeight);
+  }
+
+  // results arrive a few frames late so reading them never stalls
+  int timerSlot = gpuTimer.beginFrame();
+  for (const auto& frame : gpuTimer.getCompleted()) {
+    float ms = frame.ms[RAYMARCH_PASS];
+    raymarchTimeMs = raymarchTimeMs == 0.0f ? ms : glm::mix(raymarchTimeMs, ms, 0.05f);
+    if (dynamicResolution)
+      adjustResolution(ms, timedPixels[frame.slot]);
+  }
 
-  jitterOffset.x = taaFeedbackFactor * haltonSequence[frameCounter % maxFrames].x / static_cast<float>(renderWidth);
-  jitterOffset.y = taaFeedbackFactor * haltonSequence[frameCounter % maxFrames].y / static_cast<float>(renderHeight);
   frameCounter++;
 
-  framebuffer.bind();
-  glViewport(0, 0, renderWidth, renderHeight);
+  (accumulate ? accumFramebuffer : framebuffer).bind();
+  glViewport(0, 0, resolution.x, resolution.y);
 
   shader.use();
+  setMainUniforms(state, glm::vec4(0.0f, 0.0f, glm::vec2(resolution)), jitterOffset, fixedTime >= 0.0f ? fixedTime : static_cast<float>(glfwGetTime()));
 
-  shader.setUniformInt("uRaymarchSteps", this->raymarchSteps);
-  shader.setUniformInt("uReflRaymarchSteps", this->reflRaymarchSteps);
-  shader.setUniformFloat("uTime", static_cast<float>(glfwGetTime()));
-  shader.setUniformFloat("uFogFadeIn", fogFadeIn);
-  shader.setUniformVec2("uResolution", glm::vec2(renderWidth, renderHeight));
-  shader.setUniformVec2("uJitterOffset", jitterOffset);
-  shader.setUniformVec2("uOcclusionParams", glm::vec2(occlusionFactor, occlusionRadius));
-  shader.setUniformVec3("uAmbientColor", ambientIntensity * ambientColor);
-  shader.setUniformVec3("uProj", camera.getProjVec());
-  shader.setUniformVec3("uCamTarget", camera.target);
-  shader.setUniformVec3("uRaymarchParams", glm::vec3(this->raymarchingClipStart, this->raymarchingClipEnd, this->raymarchingPixelRadius));
-  shader.setUniformMat3("uViewRot", camera.getViewRotMat());
+  glBindVertexArray(VAO);
 
-  std::vector<float> nodeDataArray;
-  nodeDataArray.reserve(100);
-  for (const float* d : dataPointers)
-    nodeDataArray.emplace_back(*d);
+  // running mean, mean += (sample - mean) / n done by the blend unit
+  if (accumulate) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / static_cast<float>(accumulatedSamples));
+  }
 
-  shader.setUniformFloat("uN", nodeDataArray.data(), static_cast<int>(nodeDataArray.size()));
+  if (state.countSdfEvals)
+    sdfCounters.beginFrame();
 
-  taaShader.setUniformInt("uObjectData", 0);
+  gpuTimer.begin(RAYMARCH_PASS);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  gpuTimer.end();
 
-  glBindVertexArray(VAO);
+  if (state.countSdfEvals)
+    sdfCounters.endFrame();
+  timedPixels[timerSlot] = resolution.x * resolution.y;
 
-  glDrawArrays(GL_TRIANGLES, 0, 3);
+  if (accumulate) {
+    glDisable(GL_BLEND);
 
-  taaFramebuffer.bind();
-  glViewport(0, 0, width, height);
+    gpuTimer.begin(RESOLVE_PASS);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, accumFramebuffer.ID);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, taaFramebuffer.ID);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    gpuTimer.end();
+  } else {
+    taaFramebuffer.bind();
+    glViewport(0, 0, width, height);
 
-  taaShader.use();
+    taaShader.use();
 
-  taaShader.setUniformFloat("uFeedbackFactor", taaFeedbackFactor);
-  taaShader.setUniformVec2("uJitterOffset", jitterOffset);
-  taaShader.setUniformVec2("uResolution", glm::vec2(width, height));
+    taaShader.setUniform(taaUniforms.feedbackFactor, taaFeedbackFactor);
+    taaShader.setUniform(taaUniforms.jitterOffset, jitterOffset);
+    taaShader.setUniform(taaUniforms.resolution, glm::vec2(width, height));
 
-  taaShader.setUniformInt("uCurrentFrame", 0);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, framebuffer.textureID);
+    taaShader.setUniform(taaUniforms.currentFrame, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, framebuffer.textureID);
 
-  taaShader.setUniformInt("uHistoryFrame", 1);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, taaHistoryFramebuffer.textureID);
+    taaShader.setUniform(taaUniforms.historyFrame, 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, taaHistoryFramebuffer.textureID);
 
-  glDrawArrays(GL_TRIANGLES, 0, 3);
+    gpuTimer.begin(RESOLVE_PASS);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    gpuTimer.end();
+  }
 
+  gpuTimer.begin(HISTORY_PASS);
   glBindFramebuffer(GL_READ_FRAMEBUFFER, taaFramebuffer.ID);
   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, taaHistoryFramebuffer.ID);
   glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  gpuTimer.end();
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void Viewport::setMainUniforms(const RenderState& state, glm::vec4 tile, glm::vec2 jitter, float time) {
+  shader.setUniform(mainUniforms.raymarchSteps, state.raymarchSteps);
+  shader.setUniform(mainUniforms.reflRaymarchSteps, state.reflRaymarchSteps);
+  shader.setUniform(mainUniforms.time, time);
+  shader.setUniform(mainUniforms.fogFadeIn, state.fogFadeIn);
+  shader.setUniform(mainUniforms.tile, tile);
+  shader.setUniform(mainUniforms.jitterOffset, jitter);
+  shader.setUniform(mainUniforms.occlusionParams, state.occlusionParams);
+  shader.setUniform(mainUniforms.ambientColor, state.ambientColor);
+  shader.setUniform(mainUniforms.proj, state.proj);
+  shader.setUniform(mainUniforms.camTarget, state.camTarget);
+  shader.setUniform(mainUniforms.raymarchParams, state.raymarchParams);
+  shader.setUniform(mainUniforms.viewRot, state.viewRot);
+  shader.setUniform(mainUniforms.debugView, state.debugView);
+  shader.setUniform(mainUniforms.heatmapMax, state.heatmapMax);
+  shader.setUniform(mainUniforms.countEvals, state.countSdfEvals ? 1 : 0);
+}
+
+void Viewport::renderTile(const Framebuffer& target, glm::ivec4 tile, glm::ivec2 imageSize, int sample, float time) {
+  RenderState state = getRenderState();
+  state.countSdfEvals = false;
+
+  // offsets span a pixel of the whole image, not of the tile
+  float pixel = 1.0f / static_cast<float>(std::max(imageSize.x, imageSize.y));
+  glm::vec2 jitter((halton(sample, 2) - 0.5f) * pixel, (halton(sample, 3) - 0.5f) * pixel);
+
+  target.bind();
+  glViewport(0, 0, tile.z, tile.w);
+
+  shader.use();
+  setMainUniforms(state, glm::vec4(tile.x, tile.y, imageSize.x, imageSize.y), jitter, time);
+
+  glBindVertexArray(VAO);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+  glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / static_cast<float>(sample));
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glDisable(GL_BLEND);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// once the history has seen the whole jitter sequence the TAA image can't improve
+bool Viewport::converged() const { return progressive ? accumulatedSamples >= progressiveMaxSamples : staticFrames >= maxFrames; }
+
+bool Viewport::isIdle() const { return converged() && !shader.isCompiling() && !imageCapture.isBusy(); }
+
+int Viewport::getAccumulatedSamples() const { return accumulatedSamples; }
+
+void Viewport::restartAccumulation() {
+  staticFrames = 0;
+  accumulatedSamples = 0;
+}
+
+void Viewport::adjustResolution(float ms, int pixels) {
+  // cost per pixel stays comparable across resolutions and progressive frames
+  msPerPixelSum += ms / static_cast<float>(std::max(pixels, 1));
+  if (++msPerPixelSamples < resolutionInterval)
+    return;
+  float msPerPixel = msPerPixelSum / static_cast<float>(msPerPixelSamples);
+  msPerPixelSum = 0.0f;
+  msPerPixelSamples = 0;
+
+  // hysteresis, anything between 75% and 100% of the budget is left alone
+  float predictedMs = msPerPixel * static_cast<float>(renderWidth * renderHeight);
+  if (predictedMs <= frameBudgetMs && predictedMs >= 0.75f * frameBudgetMs)
+    return;
+
+  // aim for the middle of the band, pixel count grows with the square of the scale
+  float scale = std::sqrt(0.875f * frameBudgetMs / (msPerPixel * static_cast<float>(width * height)));
+  float target = glm::clamp(1.0f - scale, 0.0f, 0.95f);
+  target = std::round(target / resolutionStep) * resolutionStep;
+  if (std::abs(target - downscaleFactor) < 0.5f * resolutionStep)
+    return;
+
+  // applied by the next resize(), the jitter follows the new renderWidth/renderHeight
+  downscaleFactor = target;
+}
+
+Viewport::RenderState Viewport::getRenderState() const {
+  RenderState state;
+  state.width = width;
+  state.height = height;
+  state.renderWidth = renderWidth;
+  state.renderHeight = renderHeight;
+  state.raymarchSteps = raymarchSteps;
+  state.reflRaymarchSteps = reflRaymarchSteps;
+  state.fogFadeIn = fogFadeIn;
+  state.taaFeedbackFactor = taaFeedbackFactor;
+  state.progressive = progressive;
+  state.countSdfEvals = countSdfEvals;
+  state.debugView = debugView;
+  state.heatmapMax = heatmapMax;
+  state.occlusionParams = glm::vec2(occlusionFactor, occlusionRadius);
+  state.ambientColor = ambientIntensity * ambientColor;
+  state.proj = camera.getProjVec();
+  state.camTarget = camera.target;
+  state.raymarchParams = glm::vec3(raymarchingClipStart, raymarchingClipEnd, raymarchingPixelRadius);
+  state.viewRot = camera.getViewRotMat();
+  return state;
+}
+
+void Viewport::resolveUniforms() {
+  mainUniforms.raymarchSteps = shader.getUniform<int>("uRaymarchSteps");
+  mainUniforms.reflRaymarchSteps = shader.getUniform<int>("uReflRaymarchSteps");
+  mainUniforms.time = shader.getUniform<float>("uTime");
+  mainUniforms.fogFadeIn = shader.getUniform<float>("uFogFadeIn");
+  mainUniforms.tile = shader.getUniform<glm::vec4>("uTile");
+  mainUniforms.jitterOffset = shader.getUniform<glm::vec2>("uJitterOffset");
+  mainUniforms.occlusionParams = shader.getUniform<glm::vec2>("uOcclusionParams");
+  mainUniforms.ambientColor = shader.getUniform<glm::vec3>("uAmbientColor");
+  mainUniforms.proj = shader.getUniform<glm::vec3>("uProj");
+  mainUniforms.camTarget = shader.getUniform<glm::vec3>("uCamTarget");
+  mainUniforms.raymarchParams = shader.getUniform<glm::vec3>("uRaymarchParams");
+  mainUniforms.viewRot = shader.getUniform<glm::mat3>("uViewRot");
+  mainUniforms.debugView = shader.getUniform<int>("uDebugView");
+  mainUniforms.countEvals = shader.getUniform<int>("uCountEvals");
+  mainUniforms.heatmapMax = shader.getUniform<float>("uHeatmapMax");
+
+  taaUniforms.currentFrame = taaShader.getUniform<int>("uCurrentFrame");
+  taaUniforms.historyFrame = taaShader.getUniform<int>("uHistoryFrame");
+  taaUniforms.feedbackFactor = taaShader.getUniform<float>("uFeedbackFactor");
+  taaUniforms.jitterOffset = taaShader.getUniform<glm::vec2>("uJitterOffset");
+  taaUniforms.resolution = taaShader.getUniform<glm::vec2>("uResolution");
+}
+
 void Viewport::createMesh() {
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
@@ -228,22 +415,10 @@ void Viewport::inputScrollCallback(GLFWwindow* window, double xoffset, double yo
   }
 }
 
-void Viewport::captureImage(std::string& filePath) const {
-  taaFramebuffer.bind();
-  GLsizei nrChannels = 3;
-  GLsizei stride = nrChannels * width;
-  stride += ((stride % 4) != 0) ? (4 - stride % 4) : 0;
-  GLsizei bufferSize = stride * height;
-  std::vector<char> buffer(bufferSize);
-  glPixelStorei(GL_PACK_ALIGNMENT, 4);
-  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, buffer.data());
-  taaFramebuffer.unbind();
-
+void Viewport::captureImage(std::string& filePath) {
   if (!filePath.ends_with(".png"))
     filePath += ".png";
 
-  stbi_flip_vertically_on_write(1);
-  stbi_write_png(filePath.c_str(), width, height, nrChannels, buffer.data(), stride);
-
-  std::cout << "[Viewport] Saved capture to " << filePath << std::endl;
+  imageCapture.request(taaFramebuffer.ID, width, height, filePath);
+  std::cout << "[Viewport] Capturing to " << filePath << std::endl;
 }
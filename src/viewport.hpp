@@ -10,15 +10,21 @@
 #include <glm/glm.hpp>
 
 #include "camera.hpp"
+#include "gpu_timer.hpp"
+#include "image_capture.hpp"
+#include "node_graph.hpp"
 #include "scene.hpp"
+#include "sdf_counters.hpp"
 #include "shader.hpp"
 
 // TODO: Move this somewhere else
 class Framebuffer {
 public:
   unsigned int ID, textureID, RID;
+  GLint internalFormat;
+  GLenum format, type;
 
-  Framebuffer();
+  Framebuffer(GLint internalFormat = GL_RGB, GLenum format = GL_RGB, GLenum type = GL_UNSIGNED_BYTE);
 
   void resize(int width, int height);
 
@@ -27,6 +33,22 @@ public:
   void unbind() const;
 };
 
+// passes timed by Viewport::gpuTimer
+enum TimedPass {
+  RAYMARCH_PASS = 0,
+  RESOLVE_PASS = 1, // TAA resolve, or copying out the progressive mean
+  HISTORY_PASS = 2,
+};
+
+// uDebugView in main.fsh, false color SDF evaluations per pixel instead of the image
+enum DebugView {
+  DEBUG_NONE = 0,
+  DEBUG_COST_TOTAL = 1,
+  DEBUG_COST_PRIMARY = 2,
+  DEBUG_COST_SHADOW = 3, // shadows and reflections
+  DEBUG_COST_NORMAL = 4,
+};
+
 class Viewport {
 public:
   GLuint VAO, VBO;
@@ -37,12 +59,14 @@ public:
   Framebuffer framebuffer;
   Framebuffer taaFramebuffer;
   Framebuffer taaHistoryFramebuffer;
+  Framebuffer accumFramebuffer{GL_RGBA32F, GL_RGBA, GL_FLOAT}; // progressive running mean at full resolution
 
   Scene* scene;
+  NodeEditor* nodeEditor;
 
   Camera camera;
 
-  GLFWwindow* window;
+  GLFWwindow* window; // nullptr when rendering headless
 
   bool hovered;
 
@@ -50,6 +74,10 @@ public:
   int renderWidth, renderHeight;
   float downscaleFactor = 0.5f;
 
+  // picks downscaleFactor so the raymarch pass fits into frameBudgetMs
+  bool dynamicResolution = false;
+  float frameBudgetMs = 8.0f;
+
   float cameraSensitivity = 0.2f;
 
   glm::vec2 jitterOffset, previousJitterOffset;
@@ -68,12 +96,28 @@ public:
   int reflRaymarchSteps = 16;
   float fogFadeIn = 0.5f;
 
+  // static views accumulate full resolution samples instead of going through TAA
+  bool progressive = false;
+  int progressiveMaxSamples = 4096;
+
+  float raymarchTimeMs = 0.0f; // smoothed GPU time of the raymarch pass
+  GpuTimer gpuTimer{{"raymarch", "resolve", "history"}};
+
+  int debugView = DEBUG_NONE;
+  float heatmapMax = 256.0f; // evaluations shown as full red
+  bool countSdfEvals = false;
+  SdfCounters sdfCounters;
+
+  // benchmarking: uTime override when not negative, and rendering even once converged
+  float fixedTime = -1.0f;
+  bool alwaysRender = false;
+
   static constexpr int maxFrames = 128;
   std::array<glm::vec2, maxFrames> haltonSequence;
 
   GLuint ubo;
 
-  Viewport(GLFWwindow* window, Scene* scene);
+  Viewport(GLFWwindow* window, Scene* scene, NodeEditor* nodeEditor);
 
   ~Viewport();
 
@@ -81,15 +125,80 @@ public:
 
   void render();
 
+  // the image has converged and nothing changed, render() issues no passes
+  bool isIdle() const;
+
+  int getAccumulatedSamples() const; // 0 unless a progressive image is being shown
+
+  // the next progressive frame starts a new mean, for changes render() can't see like fixedTime
+  void restartAccumulation();
+
+  // one jittered sample of the pixels tile (x, y, width, height) of an imageSize image, blended
+  // into target as the sample-th term of a running mean. Leaves the interactive image alone.
+  void renderTile(const Framebuffer& target, glm::ivec4 tile, glm::ivec2 imageSize, int sample, float time);
+
   static void inputScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 
-  void captureImage(std::string& file) const;
+  ImageCapture imageCapture;
+
+  // queues a PNG of the last frame, written in the background by imageCapture
+  void captureImage(std::string& file);
 
 private:
   float downscaleFactorPrivate;
 
+  // everything besides the scene and node buffers that affects the image
+  struct RenderState {
+    int width, height, renderWidth, renderHeight;
+    int raymarchSteps, reflRaymarchSteps;
+    float fogFadeIn, taaFeedbackFactor;
+    bool progressive, countSdfEvals;
+    int debugView;
+    float heatmapMax;
+    glm::vec2 occlusionParams;
+    glm::vec3 ambientColor, proj, camTarget, raymarchParams;
+    glm::mat3 viewRot;
+
+    bool operator==(const RenderState&) const = default;
+  } lastRenderState = {};
+
+  int staticFrames = 0; // frames rendered since the last change
+  int accumulatedSamples = 0;
+
+  struct MainUniforms {
+    Uniform<int> raymarchSteps, reflRaymarchSteps, debugView, countEvals;
+    Uniform<float> time, fogFadeIn, heatmapMax;
+    Uniform<glm::vec2> jitterOffset, occlusionParams;
+    Uniform<glm::vec4> tile;
+    Uniform<glm::vec3> ambientColor, proj, camTarget, raymarchParams;
+    Uniform<glm::mat3> viewRot;
+  } mainUniforms;
+
+  struct TaaUniforms {
+    Uniform<int> currentFrame, historyFrame;
+    Uniform<float> feedbackFactor;
+    Uniform<glm::vec2> jitterOffset, resolution;
+  } taaUniforms;
+
+  std::array<int, GpuTimer::ringFrames> timedPixels = {}; // pixels raymarched in each gpuTimer slot
+
+  static constexpr int resolutionInterval = 8; // frames measured per resolution decision
+  static constexpr float resolutionStep = 0.05f; // downscaleFactor is kept on this grid
+  float msPerPixelSum = 0.0f;
+  int msPerPixelSamples = 0;
+
   void createMesh();
 
+  void resolveUniforms();
+
+  void setMainUniforms(const RenderState& state, glm::vec4 tile, glm::vec2 jitter, float time);
+
+  RenderState getRenderState() const;
+
+  bool converged() const;
+
+  void adjustResolution(float ms, int pixels);
+
   void precalculateHaltonSequence();
 
   float halton(int index, int base) const;